@@ -0,0 +1,587 @@
+/*
+** Asynchronous file I/O library
+** See Copyright Notice in lua.h
+*/
+
+#define laiolib_c
+#define LUA_LIB
+
+#include "lprefix.h"
+
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+/*
+** Each operation is a request run by a pool of worker threads. A
+** coroutine that starts one yields (with 'lua_yieldk') and is resumed
+** by 'aio.wait' when the request is done; the continuation of the
+** operation pushes its results. Outside a coroutine (or where it cannot
+** yield) the request runs right away, as a plain blocking call. Worker
+** threads never touch the Lua state: requests and their buffers are
+** userdata kept in the stack of the operation, which the threads only
+** fill.
+*/
+
+#if defined(LUA_USE_POSIX)	/* { */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+
+/* number of worker threads */
+#if !defined(LUAI_AIOTHREADS)
+#define LUAI_AIOTHREADS		4
+#endif
+
+
+/* key, in the registry, of the worker pool */
+static const char *const AIOPOOL = "_AIOPOOL";
+
+#define AIOFILE		"AIOFILE*"
+
+
+/* operations */
+enum { AIO_OPEN, AIO_READ, AIO_WRITE, AIO_STAT };
+
+
+typedef struct Request {
+  struct Request *next;
+  int op;
+  int fd;  /* file (result of AIO_OPEN) */
+  int flags;  /* flags for AIO_OPEN */
+  const char *path;  /* file name (AIO_OPEN, AIO_STAT) */
+  char *buff;  /* data read or to be written */
+  size_t size;  /* size of 'buff' */
+  off_t offset;  /* position, or -1 for the current one */
+  size_t done;  /* number of bytes transferred */
+  int err;  /* 'errno' of the operation (0 if ok) */
+  struct stat st;  /* result of AIO_STAT */
+  struct AFile *file;  /* file of AIO_READ/AIO_WRITE (NULL if none) */
+  int finished;  /* taken by 'aio.wait' (so results are ready) */
+  lua_State *co;  /* coroutine waiting for it (NULL if none) */
+  int ref;  /* reference that keeps 'co' alive */
+} Request;
+
+
+typedef struct Pool {
+  pthread_mutex_t lock;
+  pthread_cond_t work;  /* signaled when a request is queued */
+  pthread_cond_t done;  /* signaled when a request is done */
+  Request *queue, **queuetail;  /* requests not started */
+  Request *finished, **finishedtail;  /* requests done */
+  int pending;  /* number of requests not yet resumed */
+  int nthreads;
+  int stop;  /* workers must exit */
+  pthread_t threads[LUAI_AIOTHREADS];
+} Pool;
+
+
+typedef struct AFile {
+  int fd;  /* -1 when closed */
+  int busy;  /* number of its requests not yet taken by 'aio.wait' */
+} AFile;
+
+
+/*
+** Run request 'r'; called by the workers, or directly for synchronous
+** requests. Reads and writes loop over short transfers.
+*/
+static void perform (Request *r) {
+  ssize_t n = 0;
+  r->err = 0;
+  switch (r->op) {
+    case AIO_OPEN:
+      r->fd = open(r->path, r->flags, 0666);
+      if (r->fd < 0) r->err = errno;
+      return;
+    case AIO_STAT:
+      if (stat(r->path, &r->st) != 0) r->err = errno;
+      return;
+    case AIO_READ: case AIO_WRITE:
+      while (r->done < r->size) {
+        char *p = r->buff + r->done;
+        size_t len = r->size - r->done;
+        if (r->op == AIO_READ)
+          n = (r->offset < 0) ? read(r->fd, p, len)
+                              : pread(r->fd, p, len, r->offset + r->done);
+        else
+          n = (r->offset < 0) ? write(r->fd, p, len)
+                              : pwrite(r->fd, p, len, r->offset + r->done);
+        if (n < 0) {
+          if (errno == EINTR) continue;
+          r->err = errno;
+          return;
+        }
+        else if (n == 0)  /* end of file */
+          return;
+        r->done += (size_t)n;
+      }
+      return;
+  }
+}
+
+
+static void *worker (void *ud) {
+  Pool *P = (Pool *)ud;
+  pthread_mutex_lock(&P->lock);
+  for (;;) {
+    Request *r;
+    while (P->queue == NULL && !P->stop)
+      pthread_cond_wait(&P->work, &P->lock);
+    if (P->stop) break;
+    r = P->queue;
+    P->queue = r->next;
+    if (P->queue == NULL) P->queuetail = &P->queue;
+    pthread_mutex_unlock(&P->lock);
+    perform(r);
+    pthread_mutex_lock(&P->lock);
+    r->next = NULL;
+    *P->finishedtail = r;
+    P->finishedtail = &r->next;
+    pthread_cond_signal(&P->done);
+  }
+  pthread_mutex_unlock(&P->lock);
+  return NULL;
+}
+
+
+/*
+** Creates a request at the top of the stack, where it stays while the
+** operation is running
+*/
+static Request *newrequest (lua_State *L, int op) {
+  Request *r = (Request *)lua_newuserdata(L, sizeof(Request));
+  memset(r, 0, sizeof(Request));
+  r->op = op;
+  r->fd = -1;
+  r->offset = -1;
+  r->ref = LUA_NOREF;
+  return r;
+}
+
+
+/*
+** Stop the workers (after their current requests); files opened by
+** requests never resumed are closed. (Requests are only collected
+** after this finalizer runs, as the state is being closed.)
+*/
+static int pool_gc (lua_State *L) {
+  Pool *P = (Pool *)lua_touserdata(L, 1);
+  Request *r;
+  int i;
+  pthread_mutex_lock(&P->lock);
+  P->stop = 1;
+  pthread_cond_broadcast(&P->work);
+  pthread_mutex_unlock(&P->lock);
+  for (i = 0; i < P->nthreads; i++)
+    pthread_join(P->threads[i], NULL);
+  for (r = P->finished; r != NULL; r = r->next) {
+    if (r->op == AIO_OPEN && r->fd >= 0) close(r->fd);
+  }
+  P->queue = P->finished = NULL;
+  pthread_cond_destroy(&P->work);
+  pthread_cond_destroy(&P->done);
+  pthread_mutex_destroy(&P->lock);
+  return 0;
+}
+
+
+/*
+** Get the worker pool, creating it (and its threads) if 'create';
+** returns NULL if there is none
+*/
+static Pool *getpool (lua_State *L, int create) {
+  Pool *P;
+  if (lua_getfield(L, LUA_REGISTRYINDEX, AIOPOOL) == LUA_TUSERDATA || !create) {
+    P = (Pool *)lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    return P;
+  }
+  lua_pop(L, 1);
+  P = (Pool *)lua_newuserdata(L, sizeof(Pool));
+  memset(P, 0, sizeof(Pool));
+  pthread_mutex_init(&P->lock, NULL);
+  pthread_cond_init(&P->work, NULL);
+  pthread_cond_init(&P->done, NULL);
+  P->queuetail = &P->queue;
+  P->finishedtail = &P->finished;
+  lua_createtable(L, 0, 1);  /* its metatable */
+  lua_pushcfunction(L, pool_gc);
+  lua_setfield(L, -2, "__gc");
+  lua_setmetatable(L, -2);
+  lua_setfield(L, LUA_REGISTRYINDEX, AIOPOOL);
+  for (; P->nthreads < LUAI_AIOTHREADS; P->nthreads++) {
+    if (pthread_create(&P->threads[P->nthreads], NULL, worker, P) != 0)
+      break;
+  }
+  if (P->nthreads == 0)
+    luaL_error(L, "cannot create worker threads");
+  return P;
+}
+
+
+/*
+** Push the results of request 'r'
+*/
+static int results (lua_State *L, Request *r) {
+  if (r->err != 0) {
+    errno = r->err;
+    return luaL_fileresult(L, 0, r->path);
+  }
+  switch (r->op) {
+    case AIO_OPEN: {
+      AFile *f = (AFile *)lua_newuserdata(L, sizeof(AFile));
+      f->fd = r->fd;
+      f->busy = 0;
+      luaL_setmetatable(L, AIOFILE);
+      break;
+    }
+    case AIO_READ:
+      if (r->done == 0 && r->size > 0)
+        lua_pushnil(L);  /* end of file */
+      else
+        lua_pushlstring(L, r->buff, r->done);
+      break;
+    case AIO_WRITE:
+      lua_pushinteger(L, (lua_Integer)r->done);
+      break;
+    case AIO_STAT: {
+      const struct stat *st = &r->st;
+      const char *type = S_ISREG(st->st_mode) ? "file"
+                       : S_ISDIR(st->st_mode) ? "directory"
+                       : S_ISLNK(st->st_mode) ? "link"
+                       : S_ISFIFO(st->st_mode) ? "fifo"
+                       : S_ISSOCK(st->st_mode) ? "socket"
+                       : S_ISCHR(st->st_mode) ? "char device"
+                       : S_ISBLK(st->st_mode) ? "block device"
+                       : "other";
+      lua_createtable(L, 0, 5);
+      lua_pushstring(L, type);
+      lua_setfield(L, -2, "type");
+      lua_pushinteger(L, (lua_Integer)st->st_size);
+      lua_setfield(L, -2, "size");
+      lua_pushinteger(L, (lua_Integer)st->st_mtime);
+      lua_setfield(L, -2, "mtime");
+      lua_pushinteger(L, (lua_Integer)st->st_atime);
+      lua_setfield(L, -2, "atime");
+      lua_pushinteger(L, (lua_Integer)st->st_ctime);
+      lua_setfield(L, -2, "ctime");
+      break;
+    }
+  }
+  return 1;
+}
+
+
+/*
+** Continuation of an operation. A coroutine resumed by anything other
+** than 'aio.wait' gives up on its request, which a worker may still be
+** filling; 'aio.wait' will only release it.
+*/
+static int finishrequest (lua_State *L, int status, lua_KContext ctx) {
+  Request *r = (Request *)ctx;
+  (void)status;  /* always LUA_YIELD */
+  if (!r->finished) {
+    r->co = NULL;
+    return luaL_error(L, "aio operation resumed before it was done");
+  }
+  return results(L, r);
+}
+
+
+/*
+** Start request 'r': queue it and yield, or run it now if the caller
+** cannot yield
+*/
+static int submit (lua_State *L, Request *r) {
+  Pool *P;
+  if (!lua_isyieldable(L)) {
+    perform(r);
+    return results(L, r);
+  }
+  P = getpool(L, 1);
+  lua_pushthread(L);
+  r->co = L;
+  r->ref = luaL_ref(L, LUA_REGISTRYINDEX);  /* anchor the coroutine */
+  if (r->file != NULL)
+    r->file->busy++;
+  pthread_mutex_lock(&P->lock);
+  *P->queuetail = r;
+  P->queuetail = &r->next;
+  P->pending++;
+  pthread_cond_signal(&P->work);
+  pthread_mutex_unlock(&P->lock);
+  return lua_yieldk(L, 0, (lua_KContext)r, finishrequest);
+}
+
+
+static AFile *tofile (lua_State *L) {
+  AFile *f = (AFile *)luaL_checkudata(L, 1, AIOFILE);
+  if (f->fd < 0)
+    luaL_error(L, "attempt to use a closed file");
+  return f;
+}
+
+
+static off_t getoffset (lua_State *L, int arg) {
+  lua_Integer o = luaL_optinteger(L, arg, -1);
+  luaL_argcheck(L, o >= -1 && (lua_Integer)(off_t)o == o, arg,
+                   "offset out of range");
+  return (off_t)o;
+}
+
+
+static int aio_open (lua_State *L) {
+  static const char *const modes[] = {"r", "w", "a", "r+", "w+", "a+", NULL};
+  static const int flags[] = {
+    O_RDONLY, O_WRONLY | O_CREAT | O_TRUNC, O_WRONLY | O_CREAT | O_APPEND,
+    O_RDWR, O_RDWR | O_CREAT | O_TRUNC, O_RDWR | O_CREAT | O_APPEND
+  };
+  const char *path = luaL_checkstring(L, 1);
+  int mode = luaL_checkoption(L, 2, "r", modes);
+  Request *r = newrequest(L, AIO_OPEN);
+  r->path = path;  /* anchored at the stack of the caller */
+  r->flags = flags[mode];
+  return submit(L, r);
+}
+
+
+static int aio_stat (lua_State *L) {
+  const char *path = luaL_checkstring(L, 1);
+  Request *r = newrequest(L, AIO_STAT);
+  r->path = path;
+  return submit(L, r);
+}
+
+
+/*
+** file:read(n [, offset]): reads up to 'n' bytes; nil at end of file
+*/
+static int f_read (lua_State *L) {
+  AFile *f = tofile(L);
+  lua_Integer n = luaL_checkinteger(L, 2);
+  off_t offset = getoffset(L, 3);
+  char *buff;
+  Request *r;
+  luaL_argcheck(L, n >= 0 && (lua_Integer)(size_t)n == n, 2,
+                   "size out of range");
+  buff = (char *)lua_newuserdata(L, (size_t)n);
+  r = newrequest(L, AIO_READ);
+  r->buff = buff;
+  r->size = (size_t)n;
+  r->fd = f->fd;
+  r->file = f;
+  r->offset = offset;
+  return submit(L, r);
+}
+
+
+/*
+** file:write(s [, offset]): returns the number of bytes written
+*/
+static int f_write (lua_State *L) {
+  AFile *f = tofile(L);
+  size_t l;
+  const char *s = luaL_checklstring(L, 2, &l);
+  off_t offset = getoffset(L, 3);
+  Request *r = newrequest(L, AIO_WRITE);
+  r->buff = (char *)s;  /* string is anchored at the stack of the caller */
+  r->size = l;
+  r->fd = f->fd;
+  r->file = f;
+  r->offset = offset;
+  return submit(L, r);
+}
+
+
+/*
+** file:close(): a file with operations in progress cannot be closed,
+** as a worker may still be using its descriptor
+*/
+static int f_close (lua_State *L) {
+  AFile *f = tofile(L);
+  int res;
+  if (f->busy > 0)
+    return luaL_error(L, "cannot close a file with operations in progress");
+  res = close(f->fd);
+  f->fd = -1;
+  return luaL_fileresult(L, res == 0, NULL);
+}
+
+
+static int f_gc (lua_State *L) {
+  AFile *f = (AFile *)luaL_checkudata(L, 1, AIOFILE);
+  if (f->fd >= 0) {
+    close(f->fd);
+    f->fd = -1;
+  }
+  return 0;
+}
+
+
+static int f_tostring (lua_State *L) {
+  AFile *f = (AFile *)luaL_checkudata(L, 1, AIOFILE);
+  if (f->fd < 0)
+    lua_pushliteral(L, "aio file (closed)");
+  else
+    lua_pushfstring(L, "aio file (%d)", f->fd);
+  return 1;
+}
+
+
+/*
+** Take a finished request, waiting for one until 'deadline' (if not
+** NULL) when 'wait' is true; returns NULL if there is none
+*/
+static Request *takefinished (Pool *P, int wait,
+                              const struct timespec *deadline) {
+  Request *r;
+  pthread_mutex_lock(&P->lock);
+  while (wait && P->finished == NULL && P->pending > 0) {
+    if (deadline == NULL)
+      pthread_cond_wait(&P->done, &P->lock);
+    else if (pthread_cond_timedwait(&P->done, &P->lock, deadline) != 0)
+      break;  /* timeout */
+  }
+  r = P->finished;
+  if (r != NULL) {
+    P->finished = r->next;
+    if (P->finished == NULL) P->finishedtail = &P->finished;
+    P->pending--;
+  }
+  pthread_mutex_unlock(&P->lock);
+  return r;
+}
+
+
+/*
+** aio.wait([timeout]): waits (at most 'timeout' seconds, or forever)
+** for requests to finish and resumes their coroutines; returns how
+** many were resumed. Errors in these coroutines are propagated.
+*/
+static int aio_wait (lua_State *L) {
+  Pool *P = getpool(L, 0);
+  lua_Number timeout = luaL_optnumber(L, 1, -1);
+  struct timespec deadline;
+  int n = 0;
+  Request *r;
+  if (P == NULL) {
+    lua_pushinteger(L, 0);
+    return 1;
+  }
+  if (timeout >= 0) {
+    struct timeval now;
+    long ns;
+    gettimeofday(&now, NULL);
+    ns = (long)now.tv_usec * 1000 +
+         (long)((timeout - (lua_Number)(time_t)timeout) * 1e9);
+    deadline.tv_sec = now.tv_sec + (time_t)timeout + ns / 1000000000;
+    deadline.tv_nsec = ns % 1000000000;
+  }
+  while ((r = takefinished(P, n == 0 && timeout != 0,
+                           (timeout > 0) ? &deadline : NULL)) != NULL) {
+    lua_State *co = r->co;
+    int status;
+    r->finished = 1;
+    if (r->file != NULL)
+      r->file->busy--;
+    luaL_unref(L, LUA_REGISTRYINDEX, r->ref);  /* 'co' is on our stack */
+    if (co == NULL) continue;  /* its coroutine gave up on it */
+    lua_pushthread(co);
+    lua_xmove(co, L, 1);
+    status = lua_resume(co, L, 0);
+    n++;
+    if (status != LUA_OK && status != LUA_YIELD) {
+      lua_xmove(co, L, 1);  /* move error message */
+      return lua_error(L);
+    }
+    lua_settop(co, 0);  /* discard results or yielded values */
+    lua_pop(L, 1);  /* coroutine */
+  }
+  lua_pushinteger(L, n);
+  return 1;
+}
+
+
+/*
+** aio.pending(): number of requests whose coroutines were not resumed
+*/
+static int aio_pending (lua_State *L) {
+  Pool *P = getpool(L, 0);
+  int n = 0;
+  if (P != NULL) {
+    pthread_mutex_lock(&P->lock);
+    n = P->pending;
+    pthread_mutex_unlock(&P->lock);
+  }
+  lua_pushinteger(L, n);
+  return 1;
+}
+
+
+static const luaL_Reg aio_funcs[] = {
+  {"open", aio_open},
+  {"stat", aio_stat},
+  {"wait", aio_wait},
+  {"pending", aio_pending},
+  {NULL, NULL}
+};
+
+
+static const luaL_Reg flib[] = {
+  {"close", f_close},
+  {"read", f_read},
+  {"write", f_write},
+  {"__gc", f_gc},
+  {"__tostring", f_tostring},
+  {NULL, NULL}
+};
+
+
+static void createmeta (lua_State *L) {
+  luaL_newmetatable(L, AIOFILE);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  luaL_setfuncs(L, flib, 0);
+  lua_pop(L, 1);
+}
+
+#else				/* }{ */
+
+static int aio_notsupported (lua_State *L) {
+  return luaL_error(L, "'aio' not supported");
+}
+
+
+static const luaL_Reg aio_funcs[] = {
+  {"open", aio_notsupported},
+  {"stat", aio_notsupported},
+  {"wait", aio_notsupported},
+  {"pending", aio_notsupported},
+  {NULL, NULL}
+};
+
+
+#define createmeta(L)	((void)L)
+
+#endif				/* } */
+
+
+LUAMOD_API int luaopen_aio (lua_State *L) {
+  luaL_newlib(L, aio_funcs);
+  createmeta(L);
+  return 1;
+}
+
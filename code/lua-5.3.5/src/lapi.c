@@ -397,6 +397,38 @@ LUA_API lua_Integer lua_tointegerx(lua_State *L, int idx, int *pisnum)
   return res;
 }
 
+/*
+** Converts the 'n' values from 'idx' up, stopping at the first one that
+** is not a number; returns how many were converted
+*/
+LUA_API int lua_tonumbers(lua_State *L, int idx, int n, lua_Number *out)
+{
+  const TValue *o = index2addr(L, idx);
+  int i;
+  api_check(L, isstackindex(idx, o) &&
+               n <= L->top - o, "invalid index or not enough elements");
+  for (i = 0; i < n; i++)
+  {
+    if (!tonumber(o + i, &out[i]))
+      break;
+  }
+  return i;
+}
+
+LUA_API int lua_tointegers(lua_State *L, int idx, int n, lua_Integer *out)
+{
+  const TValue *o = index2addr(L, idx);
+  int i;
+  api_check(L, isstackindex(idx, o) &&
+               n <= L->top - o, "invalid index or not enough elements");
+  for (i = 0; i < n; i++)
+  {
+    if (!tointeger(o + i, &out[i]))
+      break;
+  }
+  return i;
+}
+
 LUA_API int lua_toboolean(lua_State *L, int idx)
 {
   const TValue *o = index2addr(L, idx);
@@ -486,6 +518,7 @@ LUA_API const void *lua_topointer(lua_State *L, int idx)
   case LUA_TCCL:
     return clCvalue(o);
   case LUA_TLCF:
+  case LUA_TLCFL:
     return cast(void *, cast(size_t, fvalue(o)));
   case LUA_TTHREAD:
     return thvalue(o);
@@ -585,6 +618,19 @@ LUA_API const char *lua_pushfstring(lua_State *L, const char *fmt, ...)
   return ret;
 }
 
+/*
+** a leaf function is a light C function that the VM calls without call
+** and return hooks
+*/
+LUA_API void lua_pushleaffunction(lua_State *L, lua_CFunction fn)
+{
+  lua_lock(L);
+  setleaffvalue(L->top, fn);
+  api_incr_top(L);
+  lua_unlock(L);
+}
+
+
 LUA_API void lua_pushcclosure(lua_State *L, lua_CFunction fn, int n)
 {
   lua_lock(L);
@@ -642,10 +688,9 @@ LUA_API int lua_pushthread(lua_State *L)
 ** get functions (Lua -> stack)
 */
 
-static int auxgetstr(lua_State *L, const TValue *t, const char *k)
+static int auxgetkey(lua_State *L, const TValue *t, TString *str)
 {
   const TValue *slot;
-  TString *str = luaS_new(L, k);
   if (luaV_fastget(L, t, str, slot, luaH_getstr))
   {
     setobj2s(L, L->top, slot);
@@ -661,6 +706,11 @@ static int auxgetstr(lua_State *L, const TValue *t, const char *k)
   return ttnov(L->top - 1);
 }
 
+static int auxgetstr(lua_State *L, const TValue *t, const char *k)
+{
+  return auxgetkey(L, t, luaS_new(L, k));
+}
+
 LUA_API int lua_getglobal(lua_State *L, const char *name)
 {
   Table *reg = hvalue(&G(L)->l_registry);
@@ -684,6 +734,48 @@ LUA_API int lua_getfield(lua_State *L, int idx, const char *k)
   return auxgetstr(L, index2addr(L, idx), k);
 }
 
+LUA_API int lua_getfieldk(lua_State *L, int idx, lua_Key k)
+{
+  lua_lock(L);
+  return auxgetkey(L, index2addr(L, idx), cast(TString *, k));
+}
+
+/*
+** Pushes t[k[i]] for the 'n' keys in 'k' with a single lock and index
+** translation (unless a metamethod runs); returns how many are not nil
+*/
+LUA_API int lua_getfields(lua_State *L, int idx, const char *const *k,
+                          int n)
+{
+  const TValue *t;
+  int i, found = 0;
+  lua_lock(L);
+  if (idx < 0 && !ispseudo(idx)) /* pushes would move a relative index */
+    idx = cast_int(L->top - (L->ci->func + 1)) + idx + 1;
+  t = index2addr(L, idx);
+  for (i = 0; i < n; i++)
+  {
+    const TValue *slot;
+    TString *str = luaS_new(L, k[i]);
+    if (luaV_fastget(L, t, str, slot, luaH_getstr))
+    {
+      setobj2s(L, L->top, slot);
+      api_incr_top(L);
+    }
+    else
+    {
+      setsvalue2s(L, L->top, str);
+      api_incr_top(L);
+      luaV_finishget(L, t, L->top - 1, L->top - 1, slot);
+      t = index2addr(L, idx); /* metamethod may have moved the stack */
+    }
+    if (!ttisnil(L->top - 1))
+      found++;
+  }
+  lua_unlock(L);
+  return found;
+}
+
 LUA_API int lua_geti(lua_State *L, int idx, lua_Integer n)
 {
   StkId t;
@@ -803,10 +895,9 @@ LUA_API int lua_getuservalue(lua_State *L, int idx)
 /*
 ** t[k] = value at the top of the stack (where 'k' is a string)
 */
-static void auxsetstr(lua_State *L, const TValue *t, const char *k)
+static void auxsetkey(lua_State *L, const TValue *t, TString *str)
 {
   const TValue *slot;
-  TString *str = luaS_new(L, k);
   api_checknelems(L, 1);
   if (luaV_fastset(L, t, str, slot, luaH_getstr, L->top - 1))
     L->top--; /* pop value */
@@ -820,6 +911,11 @@ static void auxsetstr(lua_State *L, const TValue *t, const char *k)
   lua_unlock(L); /* lock done by caller */
 }
 
+static void auxsetstr(lua_State *L, const TValue *t, const char *k)
+{
+  auxsetkey(L, t, luaS_new(L, k));
+}
+
 LUA_API void lua_setglobal(lua_State *L, const char *name)
 {
   Table *reg = hvalue(&G(L)->l_registry);
@@ -844,6 +940,12 @@ LUA_API void lua_setfield(lua_State *L, int idx, const char *k)
   auxsetstr(L, index2addr(L, idx), k);
 }
 
+LUA_API void lua_setfieldk(lua_State *L, int idx, lua_Key k)
+{
+  lua_lock(L); /* unlock done in 'auxsetkey' */
+  auxsetkey(L, index2addr(L, idx), cast(TString *, k));
+}
+
 LUA_API void lua_seti(lua_State *L, int idx, lua_Integer n)
 {
   StkId t;
@@ -908,6 +1010,136 @@ LUA_API void lua_rawsetp(lua_State *L, int idx, const void *p)
   lua_unlock(L);
 }
 
+/*
+** Reads fields of the table at 'idx' into the struct at 'p', as
+** described by 'f' (raw accesses). Absent fields are left untouched.
+** Returns 0, or the (1-based) position in 'f' of a field whose value
+** has the wrong type (the fields after it are not read).
+*/
+LUA_API int lua_getstruct(lua_State *L, int idx, void *p,
+                          const lua_Field *f, int n)
+{
+  StkId o;
+  Table *t;
+  int i;
+  lua_lock(L);
+  o = index2addr(L, idx);
+  api_check(L, ttistable(o), "table expected");
+  t = hvalue(o);
+  for (i = 0; i < n; i++)
+  {
+    const TValue *v = luaH_getstr(t, luaS_new(L, f[i].name));
+    char *field = cast(char *, p) + f[i].offset;
+    lua_Integer ii;
+    lua_Number nn;
+    if (ttisnil(v))
+      continue;
+    switch (f[i].type)
+    {
+    case LUA_FINTEGER:
+      if (!tointeger(v, cast(lua_Integer *, field)))
+        goto wrong;
+      break;
+    case LUA_FNUMBER:
+      if (!tonumber(v, cast(lua_Number *, field)))
+        goto wrong;
+      break;
+    case LUA_FINT:
+      if (!tointeger(v, &ii) || ii != cast(int, ii))
+        goto wrong;
+      *cast(int *, field) = cast_int(ii);
+      break;
+    case LUA_FFLOAT:
+      if (!tonumber(v, &nn))
+        goto wrong;
+      *cast(float *, field) = cast(float, nn);
+      break;
+    case LUA_FBOOLEAN:
+      *cast(int *, field) = !l_isfalse(v);
+      break;
+    case LUA_FSTRING:
+      if (!ttisstring(v))
+        goto wrong;
+      *cast(const char **, field) = svalue(v);
+      break;
+    default:
+      api_check(L, 0, "invalid field type");
+    }
+  }
+  lua_unlock(L);
+  return 0;
+wrong:
+  lua_unlock(L);
+  return i + 1;
+}
+
+/*
+** Writes the fields of the struct at 'p' described by 'f' into the
+** table at 'idx' (raw accesses); NULL strings are written as nil
+*/
+LUA_API void lua_setstruct(lua_State *L, int idx, const void *p,
+                           const lua_Field *f, int n)
+{
+  StkId o;
+  Table *t;
+  int i;
+  lua_lock(L);
+  o = index2addr(L, idx);
+  api_check(L, ttistable(o), "table expected");
+  t = hvalue(o);
+  for (i = 0; i < n; i++)
+  {
+    const char *field = cast(const char *, p) + f[i].offset;
+    TString *key;
+    const TValue *slot;
+    switch (f[i].type)
+    {
+    case LUA_FINTEGER:
+      setivalue(L->top, *cast(const lua_Integer *, field));
+      break;
+    case LUA_FNUMBER:
+      setfltvalue(L->top, *cast(const lua_Number *, field));
+      break;
+    case LUA_FINT:
+      setivalue(L->top, *cast(const int *, field));
+      break;
+    case LUA_FFLOAT:
+      setfltvalue(L->top, cast_num(*cast(const float *, field)));
+      break;
+    case LUA_FBOOLEAN:
+      setbvalue(L->top, *cast(const int *, field) != 0);
+      break;
+    case LUA_FSTRING:
+    {
+      const char *s = *cast(const char *const *, field);
+      if (s == NULL)
+        setnilvalue(L->top);
+      else
+        setsvalue2s(L, L->top, luaS_new(L, s));
+      break;
+    }
+    default:
+      api_check(L, 0, "invalid field type");
+    }
+    api_incr_top(L); /* anchor the value while creating the key */
+    key = luaS_new(L, f[i].name);
+    slot = luaH_getstr(t, key);
+    if (slot == luaO_nilobject) /* new key? */
+    {
+      setsvalue2s(L, L->top, key);
+      api_incr_top(L);
+      slot = luaH_newkey(L, t, L->top - 1);
+      L->top--;
+    }
+    setobj2t(L, cast(TValue *, slot), L->top - 1);
+    luaC_barrierback(L, t, L->top - 1);
+    L->top--;
+  }
+  invalidateTMcache(t);
+  luaC_checkGC(L);
+  lua_unlock(L);
+}
+
 LUA_API int lua_setmetatable(lua_State *L, int objindex)
 {
   TValue *obj;
@@ -1103,6 +1335,67 @@ LUA_API int lua_dump(lua_State *L, lua_Writer writer, void *data, int strip)
   return status;
 }
 
+/*
+** Write a snapshot of the heap (see 'luaC_heapsnapshot')
+*/
+LUA_API int lua_heapsnapshot(lua_State *L, lua_Writer writer, void *data)
+{
+  int status;
+  lua_lock(L);
+  status = luaC_heapsnapshot(L, writer, data);
+  lua_unlock(L);
+  return status;
+}
+
+/*
+** Start the allocation profiler, or stop it if 'interval' is 0
+*/
+LUA_API void lua_allocprofile(lua_State *L, size_t interval)
+{
+  lua_lock(L);
+  luaM_setprofile(L, interval);
+  lua_unlock(L);
+}
+
+/*
+** Push a sequence with the sites of the current allocation profile,
+** sorted by live bytes. Returns 0, pushing nothing, if the profiler is
+** off. (The sites are first copied to a userdata, as building the
+** result allocates and so changes them.)
+*/
+LUA_API int lua_allocsites(lua_State *L)
+{
+  SiteStat *stats;
+  size_t sz, nsz;
+  int i, n;
+  for (;;)
+  {
+    if (!luaM_sitessize(L, &sz))
+      return 0;
+    stats = cast(SiteStat *, lua_newuserdata(L, sz));
+    if (luaM_sitessize(L, &nsz) && nsz == sz)
+      break;
+    lua_pop(L, 1); /* profile changed meanwhile; try again */
+  }
+  n = luaM_copysites(L, stats);
+  lua_createtable(L, n, 0);
+  for (i = 0; i < n; i++)
+  {
+    lua_createtable(L, 0, 4);
+    lua_pushstring(L, stats[i].name);
+    lua_setfield(L, -2, "site");
+    lua_pushinteger(L, cast(lua_Integer, stats[i].live));
+    lua_setfield(L, -2, "live");
+    lua_pushinteger(L, cast(lua_Integer, stats[i].total));
+    lua_setfield(L, -2, "total");
+    lua_pushinteger(L, cast(lua_Integer, stats[i].nsamples));
+    lua_setfield(L, -2, "samples");
+    lua_rawseti(L, -2, i + 1);
+  }
+  lua_remove(L, -2); /* remove copy */
+  return 1;
+}
+
 LUA_API int lua_status(lua_State *L)
 {
   return L->status;
@@ -1207,6 +1500,59 @@ LUA_API int lua_gc(lua_State *L, int what, int data)
 ** miscellaneous functions
 */
 
+/* registry field with the keys anchored by 'lua_internkey' */
+#define KEYSTABLE "_KEYS"
+
+/*
+** Keys that already existed cannot be moved to the 'fixedgc' list;
+** they are kept in a registry table instead
+*/
+static void anchorkey(lua_State *L, TString *key)
+{
+  Table *reg = hvalue(&G(L)->l_registry);
+  TString *name = luaS_newliteral(L, KEYSTABLE);
+  const TValue *o = luaH_getshortstr(reg, name);
+  Table *keys;
+  setsvalue2s(L, L->top, key); /* anchor 'key' */
+  api_incr_top(L);
+  if (ttistable(o))
+    keys = hvalue(o);
+  else
+  {
+    keys = luaH_new(L);
+    sethvalue2s(L, L->top, keys);
+    api_incr_top(L);
+    setsvalue2s(L, L->top, name);
+    api_incr_top(L);
+    setobj2t(L, luaH_set(L, reg, L->top - 1), L->top - 2);
+    luaC_barrierback(L, reg, L->top - 2);
+    L->top -= 2;
+  }
+  setbvalue(luaH_set(L, keys, L->top - 1), 1);
+  L->top--;
+}
+
+/*
+** Interns 'k' for good: created keys are never collected (as the
+** reserved words), so the handle stays valid for the life of the state
+** and lookups with it skip 'luaS_new'
+*/
+LUA_API lua_Key lua_internkey(lua_State *L, const char *k)
+{
+  TString *ts;
+  int nuse;
+  lua_lock(L);
+  nuse = G(L)->strt.nuse;
+  ts = luaS_new(L, k);
+  api_check(L, ts->tt == LUA_TSHRSTR, "key too long");
+  if (G(L)->strt.nuse != nuse) /* created by this call? */
+    luaC_fix(L, obj2gco(ts));
+  else if (!isgray(ts)) /* not fixed already? */
+    anchorkey(L, ts);
+  lua_unlock(L);
+  return ts;
+}
+
 LUA_API int lua_error(lua_State *L)
 {
   lua_lock(L);
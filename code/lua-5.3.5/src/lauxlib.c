@@ -452,6 +452,29 @@ LUALIB_API lua_Integer luaL_optinteger (lua_State *L, int arg,
   return luaL_opt(L, luaL_checkinteger, arg, def);
 }
 
+
+/*
+** Fills the struct at 'p' from the table at argument 'arg' (see
+** 'lua_getstruct'), raising an error for a field with a wrong value
+*/
+LUALIB_API void luaL_checkstruct (lua_State *L, int arg, void *p,
+                                  const lua_Field *f, int n) {
+  static const char *const expected[] = {
+    "integer", "number", "integer", "number", "boolean", "string"
+  };
+  int i;
+  luaL_checktype(L, arg, LUA_TTABLE);
+  if ((i = lua_getstruct(L, arg, p, f, n)) != 0) {
+    const char *msg;
+    lua_pushstring(L, f[i - 1].name);
+    lua_rawget(L, arg);
+    msg = lua_pushfstring(L, "field '%s' (%s expected, got %s)",
+                             f[i - 1].name, expected[f[i - 1].type],
+                             luaL_typename(L, -1));
+    luaL_argerror(L, arg, msg);
+  }
+}
+
 /* }====================================================== */
 
 
@@ -954,6 +977,18 @@ LUALIB_API void luaL_setfuncs (lua_State *L, const luaL_Reg *l, int nup) {
 }
 
 
+/*
+** set functions from list 'l' into table at top as leaf functions
+** (see 'lua_pushleaffunction')
+*/
+LUALIB_API void luaL_setleaffuncs (lua_State *L, const luaL_Reg *l) {
+  for (; l->name != NULL; l++) {  /* fill the table with given functions */
+    lua_pushleaffunction(L, l->func);
+    lua_setfield(L, -2, l->name);
+  }
+}
+
+
 /*
 ** ensure that stack[idx][fname] has a table and push that table
 ** into the stack
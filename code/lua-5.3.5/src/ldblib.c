@@ -418,6 +418,33 @@ static int db_debug (lua_State *L) {
 }
 
 
+static int filewriter (lua_State *L, const void *b, size_t size, void *f) {
+  (void)L;  /* not used */
+  return (fwrite(b, 1, size, (FILE *)f) != size);
+}
+
+
+static int db_heapsnapshot (lua_State *L) {
+  const char *fname = luaL_checkstring(L, 1);
+  FILE *f = fopen(fname, "wb");
+  int status;
+  if (f == NULL)
+    return luaL_fileresult(L, 0, fname);
+  status = lua_heapsnapshot(L, filewriter, f);
+  if (fclose(f) != 0 || status != 0)
+    return luaL_fileresult(L, 0, fname);
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+
+static int db_vmstats (lua_State *L) {
+  if (!lua_vmstats(L, lua_toboolean(L, 1)))
+    lua_pushnil(L);  /* not built with LUAI_VMSTATS */
+  return 1;
+}
+
+
 static int db_traceback (lua_State *L) {
   int arg;
   lua_State *L1 = getthread(L, &arg);
@@ -436,6 +463,7 @@ static const luaL_Reg dblib[] = {
   {"debug", db_debug},
   {"getuservalue", db_getuservalue},
   {"gethook", db_gethook},
+  {"heapsnapshot", db_heapsnapshot},
   {"getinfo", db_getinfo},
   {"getlocal", db_getlocal},
   {"getregistry", db_getregistry},
@@ -449,6 +477,7 @@ static const luaL_Reg dblib[] = {
   {"setmetatable", db_setmetatable},
   {"setupvalue", db_setupvalue},
   {"traceback", db_traceback},
+  {"vmstats", db_vmstats},
   {NULL, NULL}
 };
 
@@ -339,6 +339,53 @@ LUA_API int lua_getinfo (lua_State *L, const char *what, lua_Debug *ar) {
 }
 
 
+#if defined(LUAI_VMSTATS)
+
+static void setstat (lua_State *L, const char *name, lu_mem n) {
+  lua_pushinteger(L, cast(lua_Integer, n));
+  lua_setfield(L, -2, name);
+}
+
+#endif
+
+
+/*
+** Pushes a table with the counters of VM activity and, if 'reset',
+** zeroes them. Returns 0, pushing nothing, when the interpreter was
+** not built with LUAI_VMSTATS.
+*/
+LUA_API int lua_vmstats (lua_State *L, int reset) {
+#if defined(LUAI_VMSTATS)
+  VMStats c = G(L)->vmstats;  /* building the table also counts */
+  VMStats *s = &c;
+  int i;
+  lua_createtable(L, 0, 5);
+  lua_createtable(L, 0, NUM_OPCODES);
+  for (i = 0; i < NUM_OPCODES; i++) {
+    if (s->op[i] > 0)  /* only opcodes that ran */
+      setstat(L, luaP_opnames[i], s->op[i]);
+  }
+  lua_setfield(L, -2, "ops");
+  lua_createtable(L, 0, 4);
+  setstat(L, "lua", s->calllua);
+  setstat(L, "c", s->callc);
+  setstat(L, "light", s->calllcf);
+  setstat(L, "leaf", s->callleaf);
+  lua_setfield(L, -2, "calls");
+  setstat(L, "finishget", s->finishget);
+  setstat(L, "finishset", s->finishset);
+  setstat(L, "concat", s->concat);
+  setstat(L, "concatbytes", s->concatbytes);
+  if (reset)
+    memset(&G(L)->vmstats, 0, sizeof(VMStats));
+  return 1;
+#else
+  UNUSED(L); UNUSED(reset);
+  return 0;
+#endif
+}
+
+
 /*
 ** {======================================================
 ** Symbolic Execution
@@ -438,7 +485,7 @@ static const char *getobjname (Proto *p, int lastpc, int reg,
   pc = findsetreg(p, lastpc, reg);
   if (pc != -1) {  /* could find instruction? */
     Instruction i = p->code[pc];
-    OpCode op = GET_OPCODE(i);
+    OpCode op = unfuseop(GET_OPCODE(i));
     switch (op) {
       case OP_MOVE: {
         int b = GETARG_B(i);  /* move from 'b' to 'a' */
@@ -482,6 +529,26 @@ static const char *getobjname (Proto *p, int lastpc, int reg,
 }
 
 
+/*
+** Name of the function called by instruction 'pc' of 'p', for tools
+** that keep (function, pc) pairs instead of CallInfo (e.g. profilers);
+** metamethod calls are not named.
+*/
+const char *luaG_callname (Proto *p, int pc, const char **name) {
+  Instruction i = p->code[pc];
+  switch (unfuseop(GET_OPCODE(i))) {
+    case OP_CALL:
+    case OP_TAILCALL:
+      return getobjname(p, pc, GETARG_A(i), name);
+    case OP_TFORCALL: {
+      *name = "for iterator";
+      return "for iterator";
+    }
+    default: return NULL;
+  }
+}
+
+
 /*
 ** Try to find a name for a function based on the code that called it.
 ** (Only works when function was called by a Lua function.)
@@ -498,7 +565,7 @@ static const char *funcnamefromcode (lua_State *L, CallInfo *ci,
     *name = "?";
     return "hook";
   }
-  switch (GET_OPCODE(i)) {
+  switch (unfuseop(GET_OPCODE(i))) {
     case OP_CALL:
     case OP_TAILCALL:
       return getobjname(p, pc, GETARG_A(i), name);  /* get function name */
@@ -7,6 +7,12 @@
 #define ldo_c
 #define LUA_CORE
 
+#if defined(LUAI_STACKRESERVE)
+/* MAP_ANONYMOUS, MAP_NORESERVE, and madvise are extensions to POSIX */
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+#endif
+
 #include "lprefix.h"
 
 
@@ -23,6 +29,7 @@
 #include "lgc.h"
 #include "lmem.h"
 #include "lobject.h"
+#include "lopt.h"
 #include "lopcodes.h"
 #include "lparser.h"
 #include "lstate.h"
@@ -163,6 +170,88 @@ int luaD_rawrunprotected (lua_State *L, Pfunc f, void *ud) {
 ** Stack reallocation
 ** ===================================================================
 */
+
+/* some space for error handling */
+#define ERRORSTACKSIZE	(LUAI_MAXSTACK + 200)
+
+
+#if defined(LUAI_STACKRESERVE)
+/*
+** Each stack is reserved at its maximum size ('ERRORSTACKSIZE' slots)
+** in virtual memory when created, so it never moves: growing only
+** erases the new segment and shrinking gives the tail pages back to the
+** system, without copies or 'correctstack'. Only the part in use is
+** accounted for by the collector. (Each thread costs some 16 MB of
+** address space; this needs memory overcommit.)
+*/
+
+#if !defined(LUA_USE_POSIX)
+#error "LUAI_STACKRESERVE needs mmap (LUA_USE_POSIX)"
+#endif
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define RESERVEDSIZE	(cast(size_t, ERRORSTACKSIZE) * sizeof(TValue))
+
+#define accountstack(L,oldsize,newsize)  \
+	(G(L)->GCdebt += cast(l_mem, (newsize) - (oldsize)) * \
+	                 cast(l_mem, sizeof(TValue)))
+
+
+TValue *luaD_newstack (lua_State *L, int size) {
+  void *p = mmap(NULL, RESERVEDSIZE, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (p == MAP_FAILED)
+    luaD_throw(L, LUA_ERRMEM);
+  accountstack(L, 0, size);
+  return cast(TValue *, p);
+}
+
+
+void luaD_freestack (lua_State *L) {
+  munmap(L->stack, RESERVEDSIZE);
+  accountstack(L, L->stacksize, 0);
+}
+
+
+/*
+** return to the system the pages between slots 'newsize' and 'oldsize'
+*/
+static void releasestack (lua_State *L, int newsize, int oldsize) {
+  size_t page = cast(size_t, sysconf(_SC_PAGESIZE));
+  size_t from = (newsize * sizeof(TValue) + page - 1) & ~(page - 1);
+  size_t to = (oldsize * sizeof(TValue) + page - 1) & ~(page - 1);
+  if (from < to)
+    madvise(cast(char *, L->stack) + from, to - from, MADV_DONTNEED);
+}
+
+
+void luaD_reallocstack (lua_State *L, int newsize) {
+  int lim = L->stacksize;
+  lua_assert(newsize <= LUAI_MAXSTACK || newsize == ERRORSTACKSIZE);
+  lua_assert(L->stack_last - L->stack == L->stacksize - EXTRA_STACK);
+  if (newsize < lim)
+    releasestack(L, newsize, lim);
+  accountstack(L, lim, newsize);
+  for (; lim < newsize; lim++)
+    setnilvalue(L->stack + lim); /* erase new segment */
+  L->stacksize = newsize;
+  L->stack_last = L->stack + newsize - EXTRA_STACK;
+}
+
+#else
+
+TValue *luaD_newstack (lua_State *L, int size) {
+  return luaM_newvector(L, size, TValue);
+}
+
+
+void luaD_freestack (lua_State *L) {
+  luaM_freearray(L, L->stack, L->stacksize);
+}
+
+
 static void correctstack (lua_State *L, TValue *oldstack) {
   CallInfo *ci;
   UpVal *up;
@@ -178,10 +267,6 @@ static void correctstack (lua_State *L, TValue *oldstack) {
 }
 
 
-/* some space for error handling */
-#define ERRORSTACKSIZE	(LUAI_MAXSTACK + 200)
-
-
 void luaD_reallocstack (lua_State *L, int newsize) {
   TValue *oldstack = L->stack;
   int lim = L->stacksize;
@@ -195,6 +280,8 @@ void luaD_reallocstack (lua_State *L, int newsize) {
   correctstack(L, oldstack);
 }
 
+#endif
+
 
 void luaD_growstack (lua_State *L, int n) {
   int size = L->stacksize;
@@ -423,9 +510,11 @@ int luaD_precall (lua_State *L, StkId func, int nresults) {
   CallInfo *ci;
   switch (ttype(func)) {
     case LUA_TCCL:  /* C closure */
+      luai_vmstat(L, callc, 1);
       f = clCvalue(func)->f;
       goto Cfunc;
-    case LUA_TLCF:  /* light C function */
+    case LUA_TLCF: case LUA_TLCFL:  /* light C function */
+      luai_vmstat(L, calllcf, 1);
       f = fvalue(func);
      Cfunc: {
       int n;  /* number of returns */
@@ -450,6 +539,7 @@ int luaD_precall (lua_State *L, StkId func, int nresults) {
       Proto *p = clLvalue(func)->p;
       int n = cast_int(L->top - func) - 1;  /* number of real arguments */
       int fsize = p->maxstacksize;  /* frame size */
+      luai_vmstat(L, calllua, 1);
       checkstackp(L, fsize, func);
       if (p->is_vararg)
         base = adjust_varargs(L, p, n);
@@ -479,6 +569,32 @@ int luaD_precall (lua_State *L, StkId func, int nresults) {
 }
 
 
+/*
+** Call a leaf light C function (see 'lua_pushleaffunction') from the
+** VM: the C case of 'luaD_precall' plus 'luaD_poscall', without call
+** and return hooks. It still gets a regular CallInfo, so errors and
+** yields work as for any other C function.
+*/
+void luaD_callleaf (lua_State *L, StkId func, int nresults) {
+  CallInfo *ci;
+  int n;  /* number of returns */
+  luai_vmstat(L, callleaf, 1);
+  checkstackp(L, LUA_MINSTACK, func);  /* ensure minimum stack size */
+  ci = next_ci(L);  /* now 'enter' new function */
+  ci->nresults = nresults;
+  ci->func = func;
+  ci->top = L->top + LUA_MINSTACK;
+  lua_assert(ci->top <= L->stack_last);
+  ci->callstatus = 0;
+  lua_unlock(L);
+  n = (*fvalue(func))(L);  /* do the actual call */
+  lua_lock(L);
+  api_checknelems(L, n);
+  L->ci = ci->previous;  /* back to caller */
+  moveresults(L, L->top - n, ci->func, n, nresults);
+}
+
+
 /*
 ** Check appropriate error for stack overflow ("regular" overflow or
 ** overflow while handling stack overflow). If 'nCalls' is larger than
@@ -655,6 +771,7 @@ static void resume (lua_State *L, void *ud) {
 
 LUA_API int lua_resume (lua_State *L, lua_State *from, int nargs) {
   int status;
+  lua_State *oldrunning;
   unsigned short oldnny = L->nny;  /* save "number of non-yieldable" calls */
   lua_lock(L);
   if (L->status == LUA_OK) {  /* may be starting a coroutine */
@@ -668,6 +785,8 @@ LUA_API int lua_resume (lua_State *L, lua_State *from, int nargs) {
     return resume_error(L, "C stack overflow", nargs);
   luai_userstateresume(L, nargs);
   L->nny = 0;  /* allow yields */
+  oldrunning = G(L)->running;
+  G(L)->running = L;
   api_checknelems(L, (L->status == LUA_OK) ? nargs + 1 : nargs);
   status = luaD_rawrunprotected(L, resume, &nargs);
   if (status == -1)  /* error calling 'lua_resume'? */
@@ -684,6 +803,7 @@ LUA_API int lua_resume (lua_State *L, lua_State *from, int nargs) {
     }
     else lua_assert(status == L->status);  /* normal end or yield */
   }
+  G(L)->running = oldrunning;
   L->nny = oldnny;  /* restore 'nny' */
   L->nCcalls--;
   lua_assert(L->nCcalls == ((from) ? from->nCcalls : 0));
@@ -783,6 +903,11 @@ static void f_parser (lua_State *L, void *ud) {
     checkmode(L, p->mode, "text");
     cl = luaY_parser(L, p->z, &p->buff, &p->dyd, p->name, c);
   }
+  if (p->mode && strchr(p->mode, 'o'))  /* optimize? */
+    luaK_optimize(L, cl->p);
+#if !defined(LUAI_NOFUSE)
+  luaK_fuse(L, cl->p);  /* create superinstructions */
+#endif
   lua_assert(cl->nupvalues == cl->p->sizeupvalues);
   luaF_initupvals(L, cl);
 }
@@ -15,6 +15,7 @@
 #include "lua.h"
 
 #include "lobject.h"
+#include "lopcodes.h"
 #include "lstate.h"
 #include "lundump.h"
 
@@ -87,9 +88,23 @@ static void DumpString (const TString *s, DumpState *D) {
 }
 
 
+/*
+** superinstructions exist only in memory: dump their basic opcodes, a
+** block of instructions at a time
+*/
 static void DumpCode (const Proto *f, DumpState *D) {
+  Instruction buff[64];
+  int pc = 0;
   DumpInt(f->sizecode, D);
-  DumpVector(f->code, f->sizecode, D);
+  while (pc < f->sizecode) {
+    int n = 0;
+    while (n < 64 && pc < f->sizecode) {
+      Instruction i = f->code[pc++];
+      SET_OPCODE(i, unfuseop(GET_OPCODE(i)));
+      buff[n++] = i;
+    }
+    DumpVector(buff, n, D);
+  }
 }
 
 
@@ -54,16 +54,28 @@ void luaF_initupvals (lua_State *L, LClosure *cl) {
 }
 
 
+/*
+** Open upvalues are also kept in 'L->uvindex', a direct-mapped table
+** keyed by stack slot, so that repeated captures of a variable do not
+** scan all open upvalues above it. Entries are removed when closed.
+*/
+#define uvindex(L,level) \
+	(&(L)->uvindex[cast_int((level) - (L)->stack) & (LUAI_UVINDEX - 1)])
+
+
 UpVal *luaF_findupval (lua_State *L, StkId level) {
   UpVal **pp = &L->openupval;
+  UpVal **idx = uvindex(L, level);
   UpVal *p;
   UpVal *uv;
   lua_assert(isintwups(L) || L->openupval == NULL);
 
+  if (*idx != NULL && (*idx)->v == level)  /* indexed? */
+    return *idx;
   while (*pp != NULL && (p = *pp)->v >= level) {
     lua_assert(upisopen(p));
     if (p->v == level)  /* found a corresponding upvalue? */
-      return p;  /* return it */
+      return *idx = p;  /* index and return it */
     pp = &p->u.open.next;
   }
 
@@ -77,6 +89,7 @@ UpVal *luaF_findupval (lua_State *L, StkId level) {
   //               u.open.next     u.open.next
 
   uv->v = level;  /* current value lives in the stack */
+  *idx = uv;
   
   if (!isintwups(L)) {  /* thread not in list of threads with upvalues? */
     // thread 链到 glbal_State 上就表示 intwups(th) 了
@@ -92,6 +105,8 @@ void luaF_close (lua_State *L, StkId level) {
   while (L->openupval != NULL && (uv = L->openupval)->v >= level) {
     lua_assert(upisopen(uv));
     L->openupval = uv->u.open.next;  /* remove from 'open' list */
+    if (*uvindex(L, uv->v) == uv)
+      *uvindex(L, uv->v) = NULL;  /* and from the index */
     if (uv->refcount == 0)  /* no references? */
       luaM_free(L, uv);  /* free upvalue */
     else {
@@ -10,6 +10,7 @@
 #include "lprefix.h"
 
 
+#include <stdio.h>
 #include <string.h>
 
 #include "lua.h"
@@ -1300,6 +1301,7 @@ void luaC_fullgc (lua_State *L, int isemergency) {
   lua_assert(g->GCestimate == gettotalbytes(g));
   luaC_runtilstate(L, bitmask(GCSpause));  /* finish collection */
 
+  luaE_flushthreads(L);  /* give back memory of dead threads */
   g->gckind = KGC_NORMAL;
   setpause(g);
 }
@@ -1307,3 +1309,254 @@ void luaC_fullgc (lua_State *L, int isemergency) {
 /* }====================================================== */
 
 
+
+/*
+** {======================================================
+** Heap snapshots
+** =======================================================
+*/
+
+typedef struct HeapWriter {
+  lua_State *L;
+  lua_Writer writer;
+  void *data;
+  int status;
+  TString *name;  /* "__name" */
+  size_t n;  /* number of bytes in 'buff' */
+  char buff[BUFSIZ];
+} HeapWriter;
+
+
+static void hsflush (HeapWriter *w) {
+  if (w->n > 0 && w->status == 0) {
+    lua_unlock(w->L);
+    w->status = (*w->writer)(w->L, w->buff, w->n, w->data);
+    lua_lock(w->L);
+  }
+  w->n = 0;
+}
+
+
+static void hsbyte (HeapWriter *w, int b) {
+  if (w->n == sizeof(w->buff))
+    hsflush(w);
+  w->buff[w->n++] = cast(char, b);
+}
+
+
+static void hssize (HeapWriter *w, size_t x) {
+  for (; x >= 0x80; x >>= 7)
+    hsbyte(w, cast_int(x & 0x7f) | 0x80);
+  hsbyte(w, cast_int(x));
+}
+
+
+#define hsobj(w,o)	hssize(w, cast(size_t, (o)))
+
+#define hsref(w,o)	{ if (iscollectable(o)) hsobj(w, gcvalue(o)); }
+
+#define hsrefN(w,o)	{ if ((o) != NULL) hsobj(w, obj2gco(o)); }
+
+
+static void hslabel (HeapWriter *w, const char *s, size_t l) {
+  size_t i;
+  if (l > LUAI_HEAPLABEL)
+    l = LUAI_HEAPLABEL;
+  hssize(w, l);
+  for (i = 0; i < l; i++)
+    hsbyte(w, cast_uchar(s[i]));
+}
+
+
+/* label of a prototype: its source position */
+static void hsposition (HeapWriter *w, Proto *p) {
+  char buff[LUA_IDSIZE + 16];
+  size_t l;
+  luaO_chunkid(buff, p->source ? getstr(p->source) : "=?", LUA_IDSIZE);
+  l = strlen(buff);
+  l_sprintf(buff + l, sizeof(buff) - l, ":%d", p->linedefined);
+  hslabel(w, buff, strlen(buff));
+}
+
+
+/*
+** Only strong references are written: a weak table does not refer to
+** its weak keys or values (an ephemeron table does refer to its values)
+*/
+static void hstable (HeapWriter *w, Table *h) {
+  const TValue *mode = gfasttm(G(w->L), h->metatable, TM_MODE);
+  int weakkey = 0, weakvalue = 0;
+  unsigned int i;
+  Node *n, *limit = gnodelast(h);
+  if (mode && ttisstring(mode)) {
+    weakkey = (strchr(svalue(mode), 'k') != NULL);
+    weakvalue = (strchr(svalue(mode), 'v') != NULL);
+  }
+  hssize(w, sizeof(Table) + sizeof(TValue) * h->sizearray +
+            sizeof(Node) * cast(size_t, allocsizenode(h)));
+  hslabel(w, "kv" + !weakkey, weakkey + weakvalue);  /* weak mode */
+  hsrefN(w, h->metatable);
+  if (!weakvalue) {
+    for (i = 0; i < h->sizearray; i++)
+      hsref(w, &h->array[i]);
+  }
+  for (n = gnode(h, 0); n < limit; n++) {
+    if (!ttisnil(gval(n))) {
+      if (!weakkey) hsref(w, gkey(n));
+      if (!weakvalue) hsref(w, gval(n));
+    }
+  }
+}
+
+
+static void hsobject (HeapWriter *w, GCObject *o) {
+  int i;
+  hsbyte(w, o->tt);
+  hsobj(w, o);
+  switch (o->tt) {
+    case LUA_TSHRSTR: case LUA_TLNGSTR: {
+      TString *ts = gco2ts(o);
+      size_t l = tsslen(ts);
+      hssize(w, sizelstring(l));
+      hslabel(w, getstr(ts), l);
+      break;
+    }
+    case LUA_TTABLE: {
+      hstable(w, gco2t(o));
+      break;
+    }
+    case LUA_TUSERDATA: {
+      Udata *u = gco2u(o);
+      TValue uv;
+      const TValue *name = (u->metatable == NULL) ? NULL :
+                                  luaH_getshortstr(u->metatable, w->name);
+      hssize(w, sizeudata(u));
+      if (name && ttisstring(name))  /* label is its type name */
+        hslabel(w, svalue(name), vslen(name));
+      else
+        hslabel(w, NULL, 0);
+      hsrefN(w, u->metatable);
+      getuservalue(w->L, u, &uv);
+      hsref(w, &uv);
+      break;
+    }
+    case LUA_TLCL: {
+      LClosure *cl = gco2lcl(o);
+      hssize(w, sizeLclosure(cl->nupvalues));
+      hsposition(w, cl->p);
+      hsrefN(w, cl->p);
+      for (i = 0; i < cl->nupvalues; i++) {
+        if (cl->upvals[i] != NULL)
+          hsref(w, cl->upvals[i]->v);
+      }
+      break;
+    }
+    case LUA_TCCL: {
+      CClosure *cl = gco2ccl(o);
+      hssize(w, sizeCclosure(cl->nupvalues));
+      hslabel(w, NULL, 0);
+      for (i = 0; i < cl->nupvalues; i++)
+        hsref(w, &cl->upvalue[i]);
+      break;
+    }
+    case LUA_TTHREAD: {
+      lua_State *th = gco2th(o);
+      StkId s;
+      hssize(w, sizeof(lua_State) + sizeof(TValue) * th->stacksize +
+                sizeof(CallInfo) * th->nci);
+      hslabel(w, NULL, 0);
+      if (th->stack != NULL) {
+        for (s = th->stack; s < th->top; s++)
+          hsref(w, s);
+      }
+      break;
+    }
+    case LUA_TPROTO: {
+      Proto *f = gco2p(o);
+      hssize(w, sizeof(Proto) + sizeof(Instruction) * f->sizecode +
+                sizeof(Proto *) * f->sizep + sizeof(TValue) * f->sizek +
+                sizeof(int) * f->sizelineinfo +
+                sizeof(LocVar) * f->sizelocvars +
+                sizeof(Upvaldesc) * f->sizeupvalues);
+      hsposition(w, f);
+      hsrefN(w, f->source);
+      for (i = 0; i < f->sizek; i++)
+        hsref(w, &f->k[i]);
+      for (i = 0; i < f->sizeupvalues; i++)
+        hsrefN(w, f->upvalues[i].name);
+      for (i = 0; i < f->sizep; i++)
+        hsrefN(w, f->p[i]);
+      for (i = 0; i < f->sizelocvars; i++)
+        hsrefN(w, f->locvars[i].varname);
+      break;
+    }
+    default: lua_assert(0);
+  }
+  hssize(w, 0);  /* end of references */
+}
+
+
+static void hslist (HeapWriter *w, GCObject *o) {
+  for (; o != NULL; o = o->next)
+    hsobject(w, o);
+}
+
+
+/* walk the heap; errors here must not leave the collector stopped */
+static void hswalk (lua_State *L, void *ud) {
+  global_State *g = G(L);
+  HeapWriter *w = cast(HeapWriter *, ud);
+  GCObject *o;
+  int i;
+  w->name = luaS_new(L, "__name");
+  for (i = 0; HEAPSIGNATURE[i] != '\0'; i++)
+    hsbyte(w, HEAPSIGNATURE[i]);
+  hsbyte(w, HEAPVERSION);
+  hsbyte(w, HS_ROOTS);
+  hsref(w, &g->l_registry);
+  hsobj(w, g->mainthread);
+  for (i = 0; i < LUA_NUMTAGS; i++)
+    hsrefN(w, g->mt[i]);
+  for (o = g->tobefnz; o != NULL; o = o->next)  /* being finalized */
+    hsobj(w, o);
+  for (o = g->fixedgc; o != NULL; o = o->next)  /* never collected */
+    hsobj(w, o);
+  hssize(w, 0);
+  hsobject(w, obj2gco(g->mainthread));  /* not in any list */
+  hslist(w, g->allgc);
+  hslist(w, g->finobj);
+  hslist(w, g->tobefnz);
+  hslist(w, g->fixedgc);
+  hsbyte(w, HS_END);
+  hsflush(w);
+}
+
+
+/*
+** Write a snapshot of all live objects, with their sizes and the
+** references among them. It runs a full collection first, so that only
+** live objects are seen, and then stops the collector while walking
+** the lists (the writer should not create objects). Memory use does
+** not depend on the size of the heap.
+*/
+int luaC_heapsnapshot (lua_State *L, lua_Writer writer, void *data) {
+  global_State *g = G(L);
+  lu_byte gcrunning = g->gcrunning;
+  HeapWriter w;
+  int status;
+  w.L = L;
+  w.writer = writer;
+  w.data = data;
+  w.status = 0;
+  w.n = 0;
+  luaC_fullgc(L, 0);
+  g->gcrunning = 0;
+  status = luaD_rawrunprotected(L, hswalk, &w);
+  g->gcrunning = gcrunning;  /* restore it even after an error */
+  if (status != LUA_OK)
+    luaD_throw(L, status);  /* propagate error */
+  return w.status;
+}
+
+/* }====================================================== */
+
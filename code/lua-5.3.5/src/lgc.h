@@ -147,6 +147,27 @@
 	(iscollectable((uv)->v) && !upisopen(uv)) ? \
          luaC_upvalbarrier_(L,uv) : cast_void(0))
 
+/*
+** Heap snapshots (see 'luaC_heapsnapshot'). Numbers are written as
+** varints (7 bits per byte, least significant first, high bit set
+** in all bytes but the last); objects are identified by address.
+**   snapshot: HEAPSIGNATURE HEAPVERSION HS_ROOTS refs { object } HS_END
+**   object:   tag address size label refs
+**   label:    length bytes (a string prefix, a source position, etc.)
+**   refs:     { address } 0
+*/
+#define HEAPSIGNATURE	"\x1bLHS"
+#define HEAPVERSION	1
+
+#define HS_END		0
+#define HS_ROOTS	0xFF
+
+/* maximum length of a label */
+#if !defined(LUAI_HEAPLABEL)
+#define LUAI_HEAPLABEL	40
+#endif
+
+
 LUAI_FUNC void luaC_fix (lua_State *L, GCObject *o);
 LUAI_FUNC void luaC_freeallobjects (lua_State *L);
 LUAI_FUNC void luaC_step (lua_State *L);
@@ -158,6 +179,8 @@ LUAI_FUNC void luaC_barrierback_ (lua_State *L, Table *o);
 LUAI_FUNC void luaC_upvalbarrier_ (lua_State *L, UpVal *uv);
 LUAI_FUNC void luaC_checkfinalizer (lua_State *L, GCObject *o, Table *mt);
 LUAI_FUNC void luaC_upvdeccount (lua_State *L, UpVal *uv);
+LUAI_FUNC int luaC_heapsnapshot (lua_State *L, lua_Writer writer,
+                                 void *data);
 
 
 #endif
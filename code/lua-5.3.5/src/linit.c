@@ -50,6 +50,12 @@ static const luaL_Reg loadedlibs[] = {
   {LUA_MATHLIBNAME, luaopen_math},
   {LUA_UTF8LIBNAME, luaopen_utf8},
   {LUA_DBLIBNAME, luaopen_debug},
+  {LUA_PROFLIBNAME, luaopen_profile},
+  {LUA_AIOLIBNAME, luaopen_aio},
+  {LUA_SCHEDLIBNAME, luaopen_sched},
+  {LUA_THREADSLIBNAME, luaopen_threads},
+  {LUA_SERIALIZELIBNAME, luaopen_serialize},
+  {LUA_JSONLIBNAME, luaopen_json},
 #if defined(LUA_COMPAT_BITLIB)
   {LUA_BITLIBNAME, luaopen_bit32},
 #endif
@@ -22,6 +22,8 @@
 #include "lauxlib.h"
 #include "lualib.h"
 
+#include "lstrlib.h"
+
 
 
 
@@ -45,6 +47,21 @@ static int l_checkmode (const char *mode) {
 
 #endif
 
+
+/*
+** Mode extension for bulk output: the file gets a buffer of
+** L_BULKBUFFER bytes, so that it is written in large blocks
+*/
+#if !defined(L_BULKMODE)
+#define L_BULKMODE	'd'
+#endif
+
+#if !defined(L_BULKBUFFER)
+#define L_BULKBUFFER	(1024 * 1024)
+#endif
+
+static const char l_bulkmode[] = {L_BULKMODE, '\0'};
+
 /*
 ** {======================================================
 ** l_popen spawns a new process connected to the current
@@ -95,6 +112,33 @@ static int l_checkmode (const char *mode) {
 #endif				/* } */
 
 
+/*
+** 'l_getbuff(f,n)' returns the characters already buffered for reading
+** in stream 'f' and sets 'n' to their number; 'l_skipbuff(f,n)' consumes
+** 'n' of them. Readers scan that buffer in bulk and go through 'l_getc'
+** only to refill it. Both need the stream locked. Where the stream
+** internals are unknown, the buffer is always empty.
+*/
+#if !defined(l_getbuff)		/* { */
+
+#if defined(__GLIBC__)
+#define l_getbuff(f,n)  \
+	((n) = (size_t)((f)->_IO_read_end - (f)->_IO_read_ptr), \
+	 (const char *)(f)->_IO_read_ptr)
+#define l_skipbuff(f,n)		((f)->_IO_read_ptr += (n))
+#elif defined(__APPLE__) || defined(__FreeBSD__) || \
+      defined(__NetBSD__) || defined(__OpenBSD__)
+#define l_getbuff(f,n)  \
+	((n) = (size_t)((f)->_r > 0 ? (f)->_r : 0), (const char *)(f)->_p)
+#define l_skipbuff(f,n)		((f)->_p += (n), (f)->_r -= (int)(n))
+#else
+#define l_getbuff(f,n)		((void)(f), (n) = 0, (const char *)NULL)
+#define l_skipbuff(f,n)		((void)(f), (void)(n))
+#endif
+
+#endif				/* } */
+
+
 /*
 ** {======================================================
 ** l_fseek: configuration for longer offsets
@@ -256,11 +300,18 @@ static void opencheck (lua_State *L, const char *fname, const char *mode) {
 static int io_open (lua_State *L) {
   const char *filename = luaL_checkstring(L, 1);
   const char *mode = luaL_optstring(L, 2, "r");
-  LStream *p = newfile(L);
-  const char *md = mode;  /* to traverse/check mode */
-  luaL_argcheck(L, l_checkmode(md), 2, "invalid mode");
+  int bulk = (strchr(mode, L_BULKMODE) != NULL);
+  LStream *p;
+  if (bulk)  /* remove bulk mark, which 'fopen' does not know */
+    mode = luaL_gsub(L, mode, l_bulkmode, "");
+  luaL_argcheck(L, l_checkmode(mode), 2, "invalid mode");
+  p = newfile(L);
   p->f = fopen(filename, mode);
-  return (p->f == NULL) ? luaL_fileresult(L, 0, filename) : 1;
+  if (p->f == NULL)
+    return luaL_fileresult(L, 0, filename);
+  if (bulk)
+    setvbuf(p->f, NULL, _IOFBF, L_BULKBUFFER);
+  return 1;
 }
 
 
@@ -386,6 +437,14 @@ static int io_lines (lua_State *L) {
 #endif
 
 
+/* decimal numerals with up to this many digits fit in a 'lua_Integer' */
+#if LUA_MAXINTEGER / 1000000000 >= 999999999
+#define L_MAXINTDIGITS	18
+#else
+#define L_MAXINTDIGITS	9
+#endif
+
+
 /* auxiliary structure used by 'read_number' */
 typedef struct {
   FILE *f;  /* file being read */
@@ -432,35 +491,86 @@ static int readdigits (RN *rn, int hex) {
 }
 
 
+/*
+** Copy a decimal numeral that ends inside the stream buffer (the
+** common case) into 'rn->buff' and consume it, following the same
+** rules as the general path below; returns 0, consuming nothing, when
+** the numeral is hexadecimal, too long, or may go on after the buffer.
+** 'isint' tells whether it is only a sign and at most L_MAXINTDIGITS
+** digits.
+*/
+static int scanbuff (RN *rn, int *isint) {
+  size_t n, i = 0, k;
+  const char *s = l_getbuff(rn->f, n);
+  int count = 0;
+  while (i < n && isspace((unsigned char)s[i])) i++;  /* skip spaces */
+  k = i;
+  if (i < n && (s[i] == '-' || s[i] == '+')) i++;  /* optional signal */
+  if (i + 1 < n && s[i] == '0' && (s[i + 1] == 'x' || s[i + 1] == 'X'))
+    return 0;  /* hexadecimal */
+  for (; i < n && isdigit((unsigned char)s[i]); i++) count++;  /* integral part */
+  *isint = (count > 0 && count <= L_MAXINTDIGITS);
+  if (i < n && s[i] == '.') {  /* decimal point? */
+    *isint = 0;
+    for (i++; i < n && isdigit((unsigned char)s[i]); i++) count++;
+  }
+  if (count > 0 && i < n && (s[i] == 'e' || s[i] == 'E')) {  /* exponent? */
+    *isint = 0;
+    if (++i < n && (s[i] == '-' || s[i] == '+')) i++;
+    while (i < n && isdigit((unsigned char)s[i])) i++;
+  }
+  if (i >= n || i - k > L_MAXLENNUM)
+    return 0;  /* read it char by char */
+  rn->n = (int)(i - k);
+  memcpy(rn->buff, s + k, rn->n);
+  l_skipbuff(rn->f, i);  /* the look-ahead char stays in the buffer */
+  return 1;
+}
+
+
 /*
 ** Read a number: first reads a valid prefix of a numeral into a buffer.
 ** Then it calls 'lua_stringtonumber' to check whether the format is
-** correct and to convert it to a Lua number
+** correct and to convert it to a Lua number; short decimal integers
+** scanned in the stream buffer are converted directly.
 */
 static int read_number (lua_State *L, FILE *f) {
   RN rn;
   int count = 0;
   int hex = 0;
+  int isint = 0;
   char decp[2];
   rn.f = f; rn.n = 0;
   decp[0] = lua_getlocaledecpoint();  /* get decimal point from locale */
   decp[1] = '.';  /* always accept a dot */
   l_lockfile(rn.f);
-  do { rn.c = l_getc(rn.f); } while (isspace(rn.c));  /* skip spaces */
-  test2(&rn, "-+");  /* optional signal */
-  if (test2(&rn, "00")) {
-    if (test2(&rn, "xX")) hex = 1;  /* numeral is hexadecimal */
-    else count = 1;  /* count initial '0' as a valid digit */
-  }
-  count += readdigits(&rn, hex);  /* integral part */
-  if (test2(&rn, decp))  /* decimal point? */
-    count += readdigits(&rn, hex);  /* fractional part */
-  if (count > 0 && test2(&rn, (hex ? "pP" : "eE"))) {  /* exponent mark? */
-    test2(&rn, "-+");  /* exponent signal */
-    readdigits(&rn, 0);  /* exponent digits */
+  if (decp[0] != '.' || !scanbuff(&rn, &isint)) {
+    isint = 0;
+    do { rn.c = l_getc(rn.f); } while (isspace(rn.c));  /* skip spaces */
+    test2(&rn, "-+");  /* optional signal */
+    if (test2(&rn, "00")) {
+      if (test2(&rn, "xX")) hex = 1;  /* numeral is hexadecimal */
+      else count = 1;  /* count initial '0' as a valid digit */
+    }
+    count += readdigits(&rn, hex);  /* integral part */
+    if (test2(&rn, decp))  /* decimal point? */
+      count += readdigits(&rn, hex);  /* fractional part */
+    if (count > 0 && test2(&rn, (hex ? "pP" : "eE"))) {  /* exponent mark? */
+      test2(&rn, "-+");  /* exponent signal */
+      readdigits(&rn, 0);  /* exponent digits */
+    }
+    ungetc(rn.c, rn.f);  /* unread look-ahead char */
   }
-  ungetc(rn.c, rn.f);  /* unread look-ahead char */
   l_unlockfile(rn.f);
+  if (isint) {  /* sign and digits that cannot overflow */
+    const char *s = rn.buff;
+    lua_Integer v = 0;
+    int neg = (*s == '-');
+    if (*s == '-' || *s == '+') s++;
+    for (; s < rn.buff + rn.n; s++) v = v * 10 + (*s - '0');
+    lua_pushinteger(L, neg ? -v : v);
+    return 1;
+  }
   rn.buff[rn.n] = '\0';  /* finish string */
   if (lua_stringtonumber(L, rn.buff))  /* is this a valid number? */
     return 1;  /* ok */
@@ -485,10 +595,30 @@ static int read_line (lua_State *L, FILE *f, int chop) {
   luaL_buffinit(L, &b);
   while (c != EOF && c != '\n') {  /* repeat until end of line */
     char *buff = luaL_prepbuffer(&b);  /* preallocate buffer */
-    int i = 0;
+    size_t i = 0;
     l_lockfile(f);  /* no memory errors can happen inside the lock */
-    while (i < LUAL_BUFFERSIZE && (c = l_getc(f)) != EOF && c != '\n')
-      buff[i++] = c;
+    while (i < LUAL_BUFFERSIZE) {
+      size_t n;
+      const char *s = l_getbuff(f, n);
+      if (n > 0) {  /* copy buffered chars up to the newline */
+        const char *eol;
+        if (n > LUAL_BUFFERSIZE - i) n = LUAL_BUFFERSIZE - i;
+        eol = (const char *)memchr(s, '\n', n);
+        if (eol != NULL) n = eol - s;
+        memcpy(buff + i, s, n);
+        i += n;
+        if (eol != NULL) {
+          l_skipbuff(f, n + 1);  /* consume also the newline */
+          c = '\n';
+          break;
+        }
+        l_skipbuff(f, n);
+      }
+      else if ((c = l_getc(f)) == EOF || c == '\n')  /* refill buffer */
+        break;
+      else
+        buff[i++] = c;
+    }
     l_unlockfile(f);
     luaL_addsize(&b, i);
   }
@@ -617,29 +747,204 @@ static int io_readline (lua_State *L) {
 /* }====================================================== */
 
 
+/*
+** {======================================================
+** WRITE
+** =======================================================
+*/
+
+
+/* maximum number of pieces gathered for one write */
+#if !defined(L_MAXPIECES)
+#define L_MAXPIECES	64
+#endif
+
+/* strings shorter than this are copied into the gather buffer */
+#if !defined(L_SMALLPIECE)
+#define L_SMALLPIECE	128
+#endif
+
+/* gathered writes at least this long skip the stream buffer */
+#if !defined(L_MINWRITEV)
+#define L_MINWRITEV	(64 * 1024)
+#endif
+
+/* room for a formatted number */
+#define L_MAXNUMLEN	50
+
+
+/*
+** 'l_writev(f,iov,n)' writes the 'n' pieces in 'iov' directly to the
+** descriptor of 'f' (whose buffer is already flushed); 'l_dropoffset'
+** then makes the stream forget its cached file position, which that
+** write made stale; it returns 0 on errors (with 'errno' set), maybe
+** after writing part of the data. Without both, 'l_haswritev' is 0 and
+** large writes go through the stream too.
+*/
+#if !defined(l_writev)		/* { */
+
+#if defined(LUA_USE_POSIX) && defined(__GLIBC__)
+#define l_dropoffset(f)		((f)->_offset = -1)
+#elif defined(LUA_USE_POSIX) && (defined(__APPLE__) || \
+      defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__))
+#define l_dropoffset(f)		((f)->_flags &= ~__SOFF)
+#endif
+
+#if defined(l_dropoffset)	/* { */
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+typedef struct iovec l_iovec;
+
+#define l_haswritev	1
+
+static int l_writev (FILE *f, l_iovec *iov, int n) {
+  int fd = fileno(f);
+  int ok = 1;
+  while (n > 0) {
+    ssize_t w = writev(fd, iov, n);
+    if (w < 0) {
+      if (errno == EINTR) continue;
+      ok = 0;
+      break;
+    }
+    while (n > 0 && (size_t)w >= iov->iov_len) {  /* skip written pieces */
+      w -= iov->iov_len;
+      iov++; n--;
+    }
+    if (n > 0) {  /* partial write of a piece */
+      iov->iov_base = (char *)iov->iov_base + w;
+      iov->iov_len -= w;
+    }
+  }
+  l_dropoffset(f);
+  return ok;
+}
+
+#else				/* }{ */
+
+typedef struct l_iovec {
+  void *iov_base;
+  size_t iov_len;
+} l_iovec;
+
+#define l_writev(f,iov,n)	((void)(f), (void)(iov), (void)(n), 0)
+#define l_haswritev	0
+
+#endif				/* } */
+
+#endif				/* } */
+
+#if !defined(l_haswritev)
+#define l_haswritev	1
+#endif
+
+
+/*
+** Convert an integer to decimal, as LUA_INTEGER_FMT does, without
+** the cost of a 'printf'
+*/
+static size_t fmtint (char *buff, lua_Integer i) {
+  char digits[L_MAXNUMLEN];
+  lua_Unsigned u = (i < 0) ? 0u - (lua_Unsigned)i : (lua_Unsigned)i;
+  size_t n = 0, len = 0;
+  do {
+    digits[n++] = (char)('0' + (int)(u % 10));
+    u /= 10;
+  } while (u != 0);
+  if (i < 0) buff[len++] = '-';
+  while (n > 0)
+    buff[len++] = digits[--n];
+  return len;
+}
+
+
+/*
+** Write the 'n' gathered pieces, with 'total' bytes: large writes go
+** directly to the file with one 'writev' (when available); otherwise
+** the pieces are written into the stream buffer under a single lock.
+** A failed 'writev' may have written part of the data, so it is never
+** retried through the stream.
+*/
+static int writepieces (FILE *f, l_iovec *iov, int n, size_t total) {
+  int status = 1;
+  int i;
+  if (l_haswritev && total >= L_MINWRITEV && fflush(f) == 0)
+    return l_writev(f, iov, n);
+  l_lockfile(f);
+  for (i = 0; i < n && status; i++)
+    status = (fwrite(iov[i].iov_base, sizeof(char), iov[i].iov_len, f)
+                == iov[i].iov_len);
+  l_unlockfile(f);
+  return status;
+}
+
+
+/*
+** Numbers and short strings are copied into a local buffer, merging
+** consecutive ones into a single piece; long strings are written from
+** where they are. So, a call like 'f:write(x, ",", y, "\n")' makes a
+** single 'fwrite'.
+*/
 static int g_write (lua_State *L, FILE *f, int arg) {
-  int nargs = lua_gettop(L) - arg;
+  int top = lua_gettop(L);
   int status = 1;
-  for (; nargs--; arg++) {
-    if (lua_type(L, arg) == LUA_TNUMBER) {
-      /* optimization: could be done exactly as for strings */
-      int len = lua_isinteger(L, arg)
-                ? fprintf(f, LUA_INTEGER_FMT,
-                             (LUAI_UACINT)lua_tointeger(L, arg))
-                : fprintf(f, LUA_NUMBER_FMT,
-                             (LUAI_UACNUMBER)lua_tonumber(L, arg));
-      status = status && (len > 0);
-    }
-    else {
+  if (arg == top - 1 && lua_type(L, arg) == LUA_TSTRING) {  /* one string? */
+    size_t l;
+    const char *s = lua_tolstring(L, arg, &l);
+    status = (fwrite(s, sizeof(char), l, f) == l);
+    arg = top;  /* nothing else to write */
+  }
+  while (arg < top) {
+    l_iovec iov[L_MAXPIECES];
+    char buff[LUAL_BUFFERSIZE];
+    size_t used = 0;  /* bytes used in 'buff' */
+    size_t total = 0;  /* total bytes in 'iov' */
+    int n = 0;  /* number of pieces */
+    for (; arg < top && n < L_MAXPIECES; arg++) {
       size_t l;
-      const char *s = luaL_checklstring(L, arg, &l);
-      status = status && (fwrite(s, sizeof(char), l, f) == l);
+      const char *s = NULL;
+      char *p = buff + used;
+      if (lua_type(L, arg) == LUA_TNUMBER) {
+        if (LUAL_BUFFERSIZE - used < L_MAXNUMLEN) break;  /* no room */
+        l = lua_isinteger(L, arg)
+            ? fmtint(p, lua_tointeger(L, arg))
+            : (size_t)lua_number2str(p, L_MAXNUMLEN, lua_tonumber(L, arg));
+      }
+      else {
+        if (n > 0 && lua_type(L, arg) != LUA_TSTRING)
+          break;  /* write what came before raising the error */
+        s = luaL_checklstring(L, arg, &l);
+        if (l < L_SMALLPIECE) {
+          if (LUAL_BUFFERSIZE - used < l) break;  /* no room */
+          memcpy(p, s, l);
+          s = NULL;  /* copied */
+        }
+      }
+      total += l;
+      if (s != NULL) {  /* long string? */
+        iov[n].iov_base = (void *)s;
+        iov[n++].iov_len = l;
+        continue;
+      }
+      if (n > 0 && (char *)iov[n - 1].iov_base + iov[n - 1].iov_len == p)
+        iov[n - 1].iov_len += l;  /* extend previous piece */
+      else {
+        iov[n].iov_base = p;
+        iov[n++].iov_len = l;
+      }
+      used += l;
     }
+    if (status)
+      status = writepieces(f, iov, n, total);
   }
   if (status) return 1;  /* file handle already on stack top */
   else return luaL_fileresult(L, status, NULL);
 }
 
+/* }====================================================== */
+
 
 static int io_write (lua_State *L) {
   return g_write(L, getiofile(L, IO_OUTPUT), 1);
@@ -694,6 +999,241 @@ static int f_flush (lua_State *L) {
 }
 
 
+/*
+** {======================================================
+** Memory-mapped files
+** =======================================================
+*/
+
+#define MAPHANDLE	"MAPPEDFILE*"
+
+typedef struct LMap {
+  const char *p;  /* contents (NULL when empty) */
+  size_t size;
+  int closed;
+} LMap;
+
+#define tolmap(L)	((LMap *)luaL_checkudata(L, 1, MAPHANDLE))
+
+
+#if !defined(l_mapfile)		/* { */
+
+#if defined(LUA_USE_POSIX)	/* { */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+** Maps file 'fname' read-only; returns 0 (with 'errno' set) on errors.
+** The file is read at most once and in order by 'lines', so tell the
+** kernel to read ahead aggressively and drop pages behind.
+*/
+static int l_mapfile (lua_State *L, LMap *m, const char *fname) {
+  struct stat st;
+  int en;
+  int fd = open(fname, O_RDONLY);
+  (void)L;
+  if (fd < 0) return 0;
+  if (fstat(fd, &st) != 0) goto fail;
+  m->size = (size_t)st.st_size;
+  if ((off_t)m->size != st.st_size) {  /* does not fit in memory? */
+    errno = EFBIG;
+    goto fail;
+  }
+  if (m->size > 0) {
+    void *p = mmap(NULL, m->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) goto fail;
+    posix_madvise(p, m->size, POSIX_MADV_SEQUENTIAL);
+    m->p = (const char *)p;
+  }
+  close(fd);  /* mapping stays valid */
+  return 1;
+ fail:
+  en = errno;
+  close(fd);
+  errno = en;
+  return 0;
+}
+
+#define l_unmapfile(m)	munmap((void *)(m)->p, (m)->size)
+
+#else				/* }{ */
+
+#define l_mapfile(L,m,f)  \
+	  ((void)(m), (void)(f), luaL_error(L, "'mmap' not supported"), 0)
+#define l_unmapfile(m)	((void)(m))
+
+#endif				/* } */
+
+#endif				/* } */
+
+
+static LMap *tomap (lua_State *L) {
+  LMap *m = tolmap(L);
+  if (m->closed)
+    luaL_error(L, "attempt to use a closed mapped file");
+  return m;
+}
+
+
+static void unmap (LMap *m) {
+  if (m->p != NULL)
+    l_unmapfile(m);
+  m->p = NULL;
+  m->size = 0;
+  m->closed = 1;
+}
+
+
+static int io_mmap (lua_State *L) {
+  const char *filename = luaL_checkstring(L, 1);
+  LMap *m = (LMap *)lua_newuserdata(L, sizeof(LMap));
+  m->p = NULL;
+  m->size = 0;
+  m->closed = 1;  /* mark as closed until mapped */
+  luaL_setmetatable(L, MAPHANDLE);
+  if (!l_mapfile(L, m, filename))
+    return luaL_fileresult(L, 0, filename);
+  m->closed = 0;
+  return 1;
+}
+
+
+static int m_close (lua_State *L) {
+  unmap(tomap(L));
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+
+static int m_gc (lua_State *L) {
+  LMap *m = tolmap(L);
+  if (!m->closed)
+    unmap(m);
+  return 0;
+}
+
+
+static int m_tostring (lua_State *L) {
+  LMap *m = tolmap(L);
+  if (m->closed)
+    lua_pushliteral(L, "mapped file (closed)");
+  else
+    lua_pushfstring(L, "mapped file (%p)", (void *)m);
+  return 1;
+}
+
+
+static int m_len (lua_State *L) {
+  lua_pushinteger(L, (lua_Integer)tomap(L)->size);
+  return 1;
+}
+
+
+/* translate a relative position, as 'string.sub' does */
+static size_t m_posrelat (lua_Integer pos, size_t len) {
+  if (pos >= 0) return (size_t)pos;
+  else if (0u - (size_t)pos > len) return 0;
+  else return len + (size_t)pos + 1;
+}
+
+
+static int m_sub (lua_State *L) {
+  LMap *m = tomap(L);
+  size_t start = m_posrelat(luaL_checkinteger(L, 2), m->size);
+  size_t end = m_posrelat(luaL_optinteger(L, 3, -1), m->size);
+  if (start < 1) start = 1;
+  if (end > m->size) end = m->size;
+  if (start <= end)
+    lua_pushlstring(L, m->p + start - 1, (end - start) + 1);
+  else lua_pushliteral(L, "");
+  return 1;
+}
+
+
+static int m_find (lua_State *L) {
+  LMap *m = tomap(L);
+  return luaI_strfind(L, m->p ? m->p : "", m->size, 1);
+}
+
+
+static int m_match (lua_State *L) {
+  LMap *m = tomap(L);
+  return luaI_strfind(L, m->p ? m->p : "", m->size, 0);
+}
+
+
+/*
+** Iterator of 'lines'. Upvalues are the map, the offset of the next
+** line, and the format: 0 for the line, 1 for the line with its
+** end-of-line, and 2 for the positions of its first and last bytes
+** (which creates no string at all).
+*/
+static int m_readline (lua_State *L) {
+  LMap *m = (LMap *)lua_touserdata(L, lua_upvalueindex(1));
+  size_t pos = (size_t)lua_tointeger(L, lua_upvalueindex(2));
+  int fmt = (int)lua_tointeger(L, lua_upvalueindex(3));
+  const char *s, *eol;
+  size_t len;
+  if (m->closed)  /* map closed during iteration? */
+    return luaL_error(L, "mapped file is already closed");
+  if (pos >= m->size) {  /* end of file? */
+    lua_pushnil(L);
+    return 1;
+  }
+  s = m->p + pos;
+  eol = (const char *)memchr(s, '\n', m->size - pos);
+  len = (eol != NULL) ? (size_t)(eol - s) : m->size - pos;
+  lua_pushinteger(L, (lua_Integer)(pos + len + (eol != NULL)));
+  lua_replace(L, lua_upvalueindex(2));
+  switch (fmt) {
+    case 0:
+      lua_pushlstring(L, s, len);
+      return 1;
+    case 1:
+      lua_pushlstring(L, s, len + (eol != NULL));
+      return 1;
+    default:
+      lua_pushinteger(L, (lua_Integer)pos + 1);
+      lua_pushinteger(L, (lua_Integer)(pos + len));
+      return 2;
+  }
+}
+
+
+static int m_lines (lua_State *L) {
+  static const char *const fmts[] = {"l", "L", "p", NULL};
+  int fmt;
+  tomap(L);  /* check that it is open */
+  fmt = luaL_checkoption(L, 2, "l", fmts);
+  lua_settop(L, 1);
+  lua_pushinteger(L, 0);  /* offset of first line */
+  lua_pushinteger(L, fmt);
+  lua_pushcclosure(L, m_readline, 3);
+  return 1;
+}
+
+
+/*
+** methods for mapped files
+*/
+static const luaL_Reg mlib[] = {
+  {"close", m_close},
+  {"find", m_find},
+  {"lines", m_lines},
+  {"match", m_match},
+  {"sub", m_sub},
+  {"__gc", m_gc},
+  {"__len", m_len},
+  {"__tostring", m_tostring},
+  {NULL, NULL}
+};
+
+/* }====================================================== */
+
+
 /*
 ** functions for 'io' library
 */
@@ -702,6 +1242,7 @@ static const luaL_Reg iolib[] = {
   {"flush", io_flush},
   {"input", io_input},
   {"lines", io_lines},
+  {"mmap", io_mmap},
   {"open", io_open},
   {"output", io_output},
   {"popen", io_popen},
@@ -736,6 +1277,11 @@ static void createmeta (lua_State *L) {
   lua_setfield(L, -2, "__index");  /* metatable.__index = metatable */
   luaL_setfuncs(L, flib, 0);  /* add file methods to new metatable */
   lua_pop(L, 1);  /* pop new metatable */
+  luaL_newmetatable(L, MAPHANDLE);  /* same for mapped files */
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  luaL_setfuncs(L, mlib, 0);
+  lua_pop(L, 1);
 }
 
 
@@ -0,0 +1,690 @@
+/*
+** JSON library
+** See Copyright Notice in lua.h
+*/
+
+#define ljsonlib_c
+#define LUA_CORE
+
+#include "lprefix.h"
+
+
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "lauxlib.h"
+#include "lualib.h"
+
+#include "lapi.h"
+#include "lgc.h"
+#include "lobject.h"
+#include "lstate.h"
+#include "ltable.h"
+
+
+/*
+** The decoder reads straight from the source string. The elements of
+** an array (or members of an object) are gathered in the stack and
+** moved to their table only when it ends (or when a batch is full),
+** so that most tables are created with their exact sizes. Strings are
+** scanned for their special characters ('"', '\\', and control
+** characters) many bytes at a time, and pushed directly when they
+** have no escapes. The encoder walks the tables directly (as
+** 'serialize' does) and writes into a buffer. JSON null is the value
+** 'json.null' (a NULL light userdata); 'json.encode' also writes nil
+** as null.
+*/
+
+
+/* maximum nesting of arrays and objects */
+#if !defined(LUAI_JSONDEPTH)
+#define LUAI_JSONDEPTH		1000
+#endif
+
+/* number of stack slots gathered before they are moved to a table */
+#if !defined(LUAI_JSONBATCH)
+#define LUAI_JSONBATCH		256
+#endif
+
+
+/* format that reads back as the same float */
+#if LUA_FLOAT_TYPE == LUA_FLOAT_FLOAT
+#define L_FMTEXACT	"%.9g"
+#elif LUA_FLOAT_TYPE == LUA_FLOAT_LONGDOUBLE
+#define L_FMTEXACT	"%.21Lg"
+#else
+#define L_FMTEXACT	"%.17g"
+#endif
+
+/* maximum size of a formatted number */
+#define MAXNUMLEN	64
+
+/* decimal numerals with up to this many digits fit in a 'lua_Integer' */
+#if LUA_MAXINTEGER / 1000000000 >= 999999999
+#define MAXINTDIGITS	18
+#else
+#define MAXINTDIGITS	9
+#endif
+
+
+#define isspecial(c) \
+  ((c) == '"' || (c) == '\\' || (unsigned char)(c) < 0x20)
+
+
+/*
+** {======================================================
+** Scanning strings
+** =======================================================
+*/
+
+/*
+** Length of the prefix of 's' (with 'n' bytes) without special
+** characters
+*/
+#if defined(__SSE2__)	/* { */
+
+#include <emmintrin.h>
+
+static size_t plainspan (const char *s, size_t n) {
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i bslash = _mm_set1_epi8('\\');
+  const __m128i ctl = _mm_set1_epi8(0x1f);
+  size_t i;
+  for (i = 0; n - i >= 16; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(s + i));
+    __m128i m = _mm_or_si128(_mm_cmpeq_epi8(x, quote),
+                             _mm_cmpeq_epi8(x, bslash));
+    int mask;
+    /* (unsigned) x <= 0x1f iff min(x, 0x1f) == x */
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_min_epu8(x, ctl), x));
+    mask = _mm_movemask_epi8(m);
+    if (mask != 0)
+      return i + (size_t)__builtin_ctz((unsigned int)mask);
+  }
+  while (i < n && !isspecial(s[i])) i++;
+  return i;
+}
+
+#else			/* }{ */
+
+/* a machine word is tested as a vector of bytes */
+typedef size_t Word;
+
+#define bytes(c)	((~(Word)0 / 0xff) * (c))
+/* some byte of 'w' is less than 'c' (for 'c' <= 0x80)? */
+#define hasless(w,c)	(((w) - bytes(c)) & ~(w) & bytes(0x80))
+
+static size_t plainspan (const char *s, size_t n) {
+  size_t i;
+  for (i = 0; n - i >= sizeof(Word); i += sizeof(Word)) {
+    Word w;
+    memcpy(&w, s + i, sizeof(Word));
+    if (hasless(w ^ bytes('"'), 1) | hasless(w ^ bytes('\\'), 1) |
+        hasless(w, 0x20))
+      break;  /* find it below */
+  }
+  while (i < n && !isspecial(s[i])) i++;
+  return i;
+}
+
+#endif			/* } */
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Decoder
+** =======================================================
+*/
+
+typedef struct Decoder {
+  lua_State *L;
+  const char *s;  /* start of the source */
+  const char *p;  /* current position */
+  const char *end;  /* end of the source (where there is a '\0') */
+} Decoder;
+
+
+static l_noret decerror (Decoder *D, const char *msg) {
+  if (D->p >= D->end)
+    msg = "unexpected end of data";
+  luaL_error(D->L, "%s at position %I", msg,
+                   (LUAI_UACINT)(D->p - D->s + 1));
+  for (;;) ;  /* not reached */
+}
+
+
+static void skipspaces (Decoder *D) {
+  const char *p = D->p;
+  while (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t') p++;
+  D->p = p;
+}
+
+
+static int gethex (Decoder *D) {
+  int i, x = 0;
+  for (i = 0; i < 4; i++) {
+    int c = (unsigned char)*D->p;
+    if ('0' <= c && c <= '9') x = x * 16 + (c - '0');
+    else if ('a' <= (c | 0x20) && (c | 0x20) <= 'f')
+      x = x * 16 + ((c | 0x20) - 'a' + 10);
+    else decerror(D, "invalid unicode escape");
+    D->p++;
+  }
+  return x;
+}
+
+
+/*
+** Add the character of the escape sequence at 'D->p' (after the
+** backslash) to buffer 'b'
+*/
+static void addescape (Decoder *D, luaL_Buffer *b) {
+  char buff[UTF8BUFFSZ];
+  unsigned long x;
+  int n;
+  switch (*D->p++) {
+    case '"': luaL_addchar(b, '"'); return;
+    case '\\': luaL_addchar(b, '\\'); return;
+    case '/': luaL_addchar(b, '/'); return;
+    case 'b': luaL_addchar(b, '\b'); return;
+    case 'f': luaL_addchar(b, '\f'); return;
+    case 'n': luaL_addchar(b, '\n'); return;
+    case 'r': luaL_addchar(b, '\r'); return;
+    case 't': luaL_addchar(b, '\t'); return;
+    case 'u': break;
+    default: D->p--; decerror(D, "invalid escape sequence");
+  }
+  x = (unsigned long)gethex(D);
+  if (0xd800 <= x && x <= 0xdbff) {  /* high surrogate? */
+    unsigned long lo;
+    if (D->p[0] != '\\' || D->p[1] != 'u')
+      decerror(D, "missing low surrogate");
+    D->p += 2;
+    lo = (unsigned long)gethex(D);
+    if (!(0xdc00 <= lo && lo <= 0xdfff))
+      decerror(D, "invalid low surrogate");
+    x = 0x10000 + ((x - 0xd800) << 10) + (lo - 0xdc00);
+  }
+  else if (0xdc00 <= x && x <= 0xdfff)
+    decerror(D, "unexpected low surrogate");
+  n = luaO_utf8esc(buff, x);
+  luaL_addlstring(b, buff + UTF8BUFFSZ - n, (size_t)n);
+}
+
+
+static void decstring (Decoder *D) {
+  luaL_Buffer b;
+  const char *p = D->p + 1;  /* skip '"' */
+  size_t k = plainspan(p, (size_t)(D->end - p));
+  if (p[k] == '"') {  /* no escapes? */
+    lua_pushlstring(D->L, p, k);
+    D->p = p + k + 1;
+    return;
+  }
+  luaL_buffinit(D->L, &b);
+  for (;;) {
+    luaL_addlstring(&b, p, k);
+    D->p = p + k;
+    if (*D->p == '"') break;
+    else if (*D->p != '\\' || D->p >= D->end)
+      decerror(D, "invalid character in string");
+    D->p++;
+    addescape(D, &b);
+    p = D->p;
+    k = plainspan(p, (size_t)(D->end - p));
+  }
+  D->p++;  /* skip '"' */
+  luaL_pushresult(&b);
+}
+
+
+#define isdig(c)	((unsigned int)((c) - '0') < 10)
+
+static void decnumber (Decoder *D) {
+  const char *p = D->p;
+  const char *digits;
+  int isint = 1;
+  if (*p == '-') p++;
+  digits = p;
+  if (*p == '0') p++;
+  else if (isdig(*p)) {
+    while (isdig(*p)) p++;
+  }
+  else decerror(D, "invalid number");
+  if (*p == '.') {
+    isint = 0;
+    if (!isdig(p[1])) { D->p = p + 1; decerror(D, "invalid number"); }
+    p += 2;
+    while (isdig(*p)) p++;
+  }
+  if (*p == 'e' || *p == 'E') {
+    isint = 0;
+    p++;
+    if (*p == '+' || *p == '-') p++;
+    if (!isdig(*p)) { D->p = p; decerror(D, "invalid number"); }
+    while (isdig(*p)) p++;
+  }
+  if (isint && p - digits <= MAXINTDIGITS) {  /* cannot overflow? */
+    lua_Integer i = 0;
+    const char *q;
+    for (q = digits; q < p; q++)
+      i = i * 10 + (*q - '0');
+    lua_pushinteger(D->L, (*D->p == '-') ? -i : i);
+  }
+  else {  /* let Lua convert it */
+    char buff[MAXNUMLEN + 1];
+    size_t l = (size_t)(p - D->p);
+    if (l > MAXNUMLEN) decerror(D, "number too long");
+    memcpy(buff, D->p, l);
+    buff[l] = '\0';
+    if (lua_stringtonumber(D->L, buff) == 0)
+      decerror(D, "invalid number");
+  }
+  D->p = p;
+}
+
+
+static void decvalue (Decoder *D, int depth);
+
+
+/*
+** Move the 'n' elements at the top to the table at 't', after its
+** first 'i' elements
+*/
+static void flusharray (lua_State *L, int t, lua_Integer i, int n) {
+  if (lua_isnil(L, t)) {
+    lua_createtable(L, n, 0);
+    lua_replace(L, t);
+  }
+  for (; n > 0; n--)
+    lua_rawseti(L, t, i + n);
+}
+
+
+static void decarray (Decoder *D, int depth) {
+  lua_State *L = D->L;
+  lua_Integer n = 0;  /* elements already in the table */
+  int held = 0;  /* elements in the stack */
+  int t;
+  lua_pushnil(L);  /* slot for the table */
+  t = lua_gettop(L);
+  D->p++;  /* skip '[' */
+  skipspaces(D);
+  if (*D->p == ']') {
+    D->p++;
+    lua_newtable(L);
+    lua_replace(L, t);
+    return;
+  }
+  for (;;) {
+    decvalue(D, depth + 1);
+    if (++held == LUAI_JSONBATCH) {
+      flusharray(L, t, n, held);
+      n += held;
+      held = 0;
+    }
+    skipspaces(D);
+    if (*D->p == ',') D->p++;
+    else if (*D->p == ']') break;
+    else decerror(D, "expected ',' or ']'");
+  }
+  D->p++;  /* skip ']' */
+  flusharray(L, t, n, held);
+}
+
+
+/*
+** Move the 'n' pairs at the top to the table at 't', in order (so
+** that later keys win)
+*/
+static void flushobject (lua_State *L, int t, int n) {
+  int i, base = lua_gettop(L) - 2 * n;
+  if (lua_isnil(L, t)) {
+    lua_createtable(L, 0, n);
+    lua_replace(L, t);
+  }
+  for (i = base + 1; i <= base + 2 * n; i += 2) {
+    lua_pushvalue(L, i);
+    lua_pushvalue(L, i + 1);
+    lua_rawset(L, t);
+  }
+  lua_settop(L, base);
+}
+
+
+static void decobject (Decoder *D, int depth) {
+  lua_State *L = D->L;
+  int held = 0;  /* pairs in the stack */
+  int t;
+  lua_pushnil(L);  /* slot for the table */
+  t = lua_gettop(L);
+  D->p++;  /* skip '{' */
+  skipspaces(D);
+  if (*D->p == '}') {
+    D->p++;
+    lua_newtable(L);
+    lua_replace(L, t);
+    return;
+  }
+  for (;;) {
+    skipspaces(D);
+    if (*D->p != '"') decerror(D, "expected string key");
+    decstring(D);
+    skipspaces(D);
+    if (*D->p != ':') decerror(D, "expected ':'");
+    D->p++;
+    decvalue(D, depth + 1);
+    if (++held == LUAI_JSONBATCH / 2) {
+      flushobject(L, t, held);
+      held = 0;
+    }
+    skipspaces(D);
+    if (*D->p == ',') D->p++;
+    else if (*D->p == '}') break;
+    else decerror(D, "expected ',' or '}'");
+  }
+  D->p++;  /* skip '}' */
+  flushobject(L, t, held);
+}
+
+
+static void decliteral (Decoder *D, const char *lit, size_t l) {
+  if ((size_t)(D->end - D->p) < l || memcmp(D->p, lit, l) != 0)
+    decerror(D, "invalid value");
+  D->p += l;
+}
+
+
+static void decvalue (Decoder *D, int depth) {
+  lua_State *L = D->L;
+  skipspaces(D);
+  switch (*D->p) {
+    case '{': case '[': {
+      if (depth >= LUAI_JSONDEPTH)
+        decerror(D, "too many nested arrays or objects");
+      luaL_checkstack(L, LUAI_JSONBATCH + 3,
+                         "too many nested arrays or objects");
+      if (*D->p == '{') decobject(D, depth);
+      else decarray(D, depth);
+      break;
+    }
+    case '"': decstring(D); break;
+    case 't': decliteral(D, "true", 4); lua_pushboolean(L, 1); break;
+    case 'f': decliteral(D, "false", 5); lua_pushboolean(L, 0); break;
+    case 'n': decliteral(D, "null", 4); lua_pushlightuserdata(L, NULL); break;
+    case '-': case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9':
+      decnumber(D);
+      break;
+    default: decerror(D, "invalid value");
+  }
+}
+
+
+static int json_decode (lua_State *L) {
+  Decoder D;
+  size_t l;
+  const char *s = luaL_checklstring(L, 1, &l);
+  D.L = L;
+  D.s = D.p = s;
+  D.end = s + l;
+  decvalue(&D, 0);
+  skipspaces(&D);
+  if (D.p < D.end)
+    decerror(&D, "unexpected character after value");
+  return 1;
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Encoder
+** =======================================================
+*/
+
+typedef struct Encoder {
+  lua_State *L;
+  luaL_Buffer b;
+  int box;  /* stack slot for the box of 'b' */
+} Encoder;
+
+
+/*
+** As the stack is in use (tables being walked are anchored there),
+** the box of the buffer (created by its first growth, at the top) is
+** moved to a fixed slot, and brought back to the top only to grow
+*/
+static void growbuff (Encoder *E, size_t sz) {
+  luaL_Buffer *B = &E->b;
+  if (B->b != B->initb) {  /* box already exists? */
+    lua_pushvalue(E->L, E->box);
+    luaL_prepbuffsize(B, sz);
+    lua_pop(E->L, 1);
+  }
+  else {
+    luaL_prepbuffsize(B, sz);
+    lua_replace(E->L, E->box);
+  }
+}
+
+
+#define prepbuff(E,sz) \
+  ((E)->b.size - (E)->b.n < (sz) ? growbuff(E, sz) : (void)0, \
+   (E)->b.b + (E)->b.n)
+
+#define addsize(E,sz)	((E)->b.n += (sz))
+
+
+static void addchar (Encoder *E, int c) {
+  *prepbuff(E, 1) = (char)c;
+  addsize(E, 1);
+}
+
+
+static void addmem (Encoder *E, const char *s, size_t l) {
+  memcpy(prepbuff(E, l), s, l);
+  addsize(E, l);
+}
+
+
+static void encstring (Encoder *E, const char *s, size_t l) {
+  static const char hex[] = "0123456789abcdef";
+  addchar(E, '"');
+  for (;;) {
+    size_t k = plainspan(s, l);
+    char *p;
+    addmem(E, s, k);
+    if (k == l) break;
+    s += k; l -= k;
+    p = prepbuff(E, 6);
+    p[0] = '\\';
+    switch (*s) {
+      case '"': case '\\': p[1] = *s; addsize(E, 2); break;
+      case '\b': p[1] = 'b'; addsize(E, 2); break;
+      case '\f': p[1] = 'f'; addsize(E, 2); break;
+      case '\n': p[1] = 'n'; addsize(E, 2); break;
+      case '\r': p[1] = 'r'; addsize(E, 2); break;
+      case '\t': p[1] = 't'; addsize(E, 2); break;
+      default:
+        memcpy(p + 1, "u00", 3);
+        p[4] = hex[(unsigned char)*s >> 4];
+        p[5] = hex[*s & 0xf];
+        addsize(E, 6);
+    }
+    s++; l--;
+  }
+  addchar(E, '"');
+}
+
+
+static void encnumber (Encoder *E, const TValue *o) {
+  char *p = prepbuff(E, MAXNUMLEN);
+  int n;
+  if (ttisinteger(o))
+    n = lua_integer2str(p, MAXNUMLEN, ivalue(o));
+  else {
+    lua_Number x = fltvalue(o);
+    char *dp;
+    if (x != x || x - x != 0)  /* NaN or infinity? */
+      luaL_error(E->L, "cannot encode NaN or infinity");
+    n = lua_number2str(p, MAXNUMLEN, x);
+    if (lua_str2number(p, NULL) != x)  /* not exact? */
+      n = l_sprintf(p, MAXNUMLEN, L_FMTEXACT, (LUAI_UACNUMBER)x);
+    if ((dp = strchr(p, lua_getlocaledecpoint())) != NULL)
+      *dp = '.';  /* JSON always uses a dot */
+    else if (p[strspn(p, "-0123456789")] == '\0') {  /* looks like an int? */
+      p[n++] = '.';  /* keep it a float */
+      p[n++] = '0';
+    }
+  }
+  addsize(E, n);
+}
+
+
+static void encode (Encoder *E, const TValue *o, int depth);
+
+/*
+** Tables with only positive integer keys, using at least half of
+** [1, max key], are arrays (with nulls in their holes); others are
+** objects, with numeric keys written as strings
+*/
+static void enctable (Encoder *E, Table *t, int depth) {
+  lua_State *L = E->L;
+  unsigned int i, asize = t->sizearray;
+  int j, nodes = allocsizenode(t);
+  lua_Integer count = 0, maxkey;
+  int isarray = 1;
+  if (depth >= LUAI_JSONDEPTH)
+    luaL_error(L, "table too deep (or cyclic) to encode");
+  luaL_checkstack(L, 2, "table too deep to encode");
+  sethvalue(L, L->top, t);  /* anchor it */
+  api_incr_top(L);
+  while (asize > 0 && ttisnil(&t->array[asize - 1])) asize--;
+  for (i = 0; i < asize; i++) {
+    if (!ttisnil(&t->array[i])) count++;
+  }
+  maxkey = asize;
+  for (j = 0; j < nodes && isarray; j++) {
+    Node *n = gnode(t, j);
+    if (!ttisnil(gval(n))) {
+      if (ttisinteger(gkey(n)) && ivalue(gkey(n)) > 0) {
+        count++;
+        if (ivalue(gkey(n)) > maxkey) maxkey = ivalue(gkey(n));
+      }
+      else isarray = 0;
+    }
+  }
+  if (count == 0 || maxkey - count > count)
+    isarray = 0;
+  if (isarray) {
+    lua_Integer k;
+    addchar(E, '[');
+    for (k = 1; k <= maxkey; k++) {
+      if (k > 1) addchar(E, ',');
+      encode(E, ((lua_Unsigned)k <= asize) ? &t->array[k - 1] : luaH_getint(t, k),
+                depth + 1);
+    }
+    addchar(E, ']');
+  }
+  else {
+    int first = 1;
+    addchar(E, '{');
+    for (i = 0; i < asize; i++) {
+      if (!ttisnil(&t->array[i])) {
+        char *p;
+        if (!first) addchar(E, ',');
+        first = 0;
+        p = prepbuff(E, MAXNUMLEN + 3);
+        *p = '"';
+        addsize(E, 1 + lua_integer2str(p + 1, MAXNUMLEN, (lua_Integer)i + 1));
+        addmem(E, "\":", 2);
+        encode(E, &t->array[i], depth + 1);
+      }
+    }
+    for (j = 0; j < nodes; j++) {
+      Node *n = gnode(t, j);
+      const TValue *key = gkey(n);
+      if (ttisnil(gval(n))) continue;
+      if (!first) addchar(E, ',');
+      first = 0;
+      if (ttisstring(key))
+        encstring(E, getstr(tsvalue(key)), tsslen(tsvalue(key)));
+      else if (ttisnumber(key)) {
+        addchar(E, '"');
+        encnumber(E, key);
+        addchar(E, '"');
+      }
+      else
+        luaL_error(L, "cannot encode a table key of type %s",
+                      lua_typename(L, ttnov(key)));
+      addchar(E, ':');
+      encode(E, gval(n), depth + 1);
+    }
+    addchar(E, '}');
+  }
+  L->top--;
+}
+
+
+static void encode (Encoder *E, const TValue *o, int depth) {
+  switch (ttype(o)) {
+    case LUA_TNIL: addmem(E, "null", 4); break;
+    case LUA_TBOOLEAN:
+      if (bvalue(o)) addmem(E, "true", 4);
+      else addmem(E, "false", 5);
+      break;
+    case LUA_TNUMINT: case LUA_TNUMFLT: encnumber(E, o); break;
+    case LUA_TSHRSTR: case LUA_TLNGSTR:
+      encstring(E, getstr(tsvalue(o)), tsslen(tsvalue(o)));
+      break;
+    case LUA_TTABLE: enctable(E, hvalue(o), depth); break;
+    default:
+      if (ttislightuserdata(o) && pvalue(o) == NULL)  /* json.null? */
+        addmem(E, "null", 4);
+      else
+        luaL_error(E->L, "cannot encode a %s value",
+                         lua_typename(E->L, ttnov(o)));
+  }
+}
+
+
+static int json_encode (lua_State *L) {
+  Encoder E;
+  luaL_checkany(L, 1);
+  lua_settop(L, 1);
+  lua_pushnil(L);  /* slot for the box */
+  E.L = L;
+  E.box = 2;
+  luaL_buffinit(L, &E.b);
+  encode(&E, L->ci->func + 1, 0);
+  lua_settop(L, (E.b.b != E.b.initb) ? E.box : E.box - 1);
+  luaL_pushresult(&E.b);
+  return 1;
+}
+
+/* }====================================================== */
+
+
+static const luaL_Reg json_funcs[] = {
+  {"decode", json_decode},
+  {"encode", json_encode},
+  {"null", NULL},  /* place holder */
+  {NULL, NULL}
+};
+
+
+LUAMOD_API int luaopen_json (lua_State *L) {
+  luaL_newlib(L, json_funcs);
+  lua_pushlightuserdata(L, NULL);
+  lua_setfield(L, -2, "null");
+  return 1;
+}
+
@@ -69,6 +69,79 @@ static void save (LexState *ls, int c) {
   b->buffer[luaZ_bufflen(b)++] = cast(char, c);
 }
 
+/*
+** {======================================================
+** Bulk scanning: 'ls->current' is the last char taken from the input
+** stream and the rest of the current input block is at 'z->p' ('z->n'
+** bytes). The functions below measure runs of that block that belong
+** to the same lexical element and consume them at once, instead of
+** going through 'next' and 'save' for each char. They must not be
+** called when 'ls->current' is EOZ.
+** =======================================================
+*/
+
+/* length of the run of buffered chars that may continue a name */
+static size_t span_alnum (const ZIO *z) {
+  const char *p = z->p;
+  const char *e = p + z->n;
+  while (p < e && lislalnum(cast_uchar(*p))) p++;
+  return cast(size_t, p - z->p);
+}
+
+
+/* length of the run of buffered blanks (spaces other than newlines) */
+static size_t span_blank (const ZIO *z) {
+  const char *p = z->p;
+  const char *e = p + z->n;
+  while (p < e && (*p == ' ' || *p == '\t' || *p == '\f' || *p == '\v'))
+    p++;
+  return cast(size_t, p - z->p);
+}
+
+
+/* length of the run of buffered chars other than 'c1', 'c2' and newlines */
+static size_t span_except (const ZIO *z, int c1, int c2) {
+  const char *p = z->p;
+  const char *e = p + z->n;
+  while (p < e) {
+    int c = cast_uchar(*p);
+    if (c == c1 || c == c2 || c == '\n' || c == '\r') break;
+    p++;
+  }
+  return cast(size_t, p - z->p);
+}
+
+
+/* skip 'ls->current' and the next 'n' buffered chars */
+static void skip_run (LexState *ls, size_t n) {
+  ls->z->p += n;
+  ls->z->n -= n;
+  next(ls);
+}
+
+
+/* save 'ls->current' and the next 'n' buffered chars, copying them once */
+static void save_run (LexState *ls, size_t n) {
+  ZIO *z = ls->z;
+  Mbuffer *b = ls->buff;
+  if (n >= luaZ_sizebuffer(b) - luaZ_bufflen(b)) {  /* no room for n + 1? */
+    size_t newsize = luaZ_sizebuffer(b);
+    do {
+      if (newsize >= MAX_SIZE/2)
+        lexerror(ls, "lexical element too long", 0);
+      newsize *= 2;
+    } while (newsize - luaZ_bufflen(b) <= n);
+    luaZ_resizebuffer(ls->L, b, newsize);
+  }
+  b->buffer[luaZ_bufflen(b)++] = cast(char, ls->current);
+  memcpy(b->buffer + luaZ_bufflen(b), z->p, n);
+  luaZ_bufflen(b) += n;
+  skip_run(ls, n);
+}
+
+/* }====================================================== */
+
+
 /**
  * 初始化 "_ENV" 和 保留字
 */
@@ -294,8 +367,8 @@ static void read_long_string (LexState *ls, SemInfo *seminfo, int sep) {
         break;
       }
       default: {
-        if (seminfo) save_and_next(ls);
-        else next(ls);
+        if (seminfo) save_run(ls, span_except(ls->z, ']', ']'));
+        else skip_run(ls, span_except(ls->z, ']', ']'));
       }
     }
   } endloop:
@@ -422,7 +495,7 @@ static void read_string (LexState *ls, int del, SemInfo *seminfo) {
        no_save: break;
       }
       default:
-        save_and_next(ls);
+        save_run(ls, span_except(ls->z, del, '\\'));
     }
   }
   save_and_next(ls);  /* skip delimiter */
@@ -440,7 +513,7 @@ static int llex (LexState *ls, SemInfo *seminfo) {
         break;
       }
       case ' ': case '\f': case '\t': case '\v': {  /* spaces */
-        next(ls);
+        skip_run(ls, span_blank(ls->z));
         break;
       }
       case '-': {  /* '-' or '--' (comment) */
@@ -458,8 +531,8 @@ static int llex (LexState *ls, SemInfo *seminfo) {
           }
         }
         /* else short comment */
-        while (!currIsNewline(ls) && ls->current != EOZ)
-          next(ls);  /* skip until end of line (or end of file) */
+        while (!currIsNewline(ls) && ls->current != EOZ)  /* skip until end */
+          skip_run(ls, span_except(ls->z, '\n', '\r'));  /* of line or file */
         break;
       }
       case '[': {  /* long string or simply '[' */
@@ -529,7 +602,7 @@ static int llex (LexState *ls, SemInfo *seminfo) {
         if (lislalpha(ls->current)) {  /* identifier or reserved word? */
           TString *ts;
           do {
-            save_and_next(ls);
+            save_run(ls, span_alnum(ls->z));
           } while (lislalnum(ls->current));
           ts = luaX_newstring(ls, luaZ_buffer(ls->buff),
                                   luaZ_bufflen(ls->buff));
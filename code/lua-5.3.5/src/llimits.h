@@ -154,6 +154,28 @@ typedef LUAI_UACINT l_uacInt;
 #endif
 
 
+/*
+** maximum number of dead threads kept by the collector for reuse by
+** 'lua_newthread', and maximum stack size (in slots) of a kept thread.
+** (Define LUAI_MAXPOOLTHREADS as 0 to disable thread reuse.)
+*/
+#if !defined(LUAI_MAXPOOLTHREADS)
+#define LUAI_MAXPOOLTHREADS	32
+#endif
+
+#if !defined(LUAI_MAXPOOLSTACK)
+#define LUAI_MAXPOOLSTACK	1024
+#endif
+
+
+/*
+** size of the per-thread index of open upvalues (must be a power of 2)
+*/
+#if !defined(LUAI_UVINDEX)
+#define LUAI_UVINDEX	16
+#endif
+
+
 
 /*
 ** type for virtual-machine instructions;
@@ -11,6 +11,9 @@
 
 
 #include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "lua.h"
 
@@ -20,6 +23,7 @@
 #include "lmem.h"
 #include "lobject.h"
 #include "lstate.h"
+#include "lstring.h"
 
 
 
@@ -71,6 +75,317 @@ l_noret luaM_toobig (lua_State *L) {
 
 
 
+/*
+** {======================================================
+** Allocation profiler
+** =======================================================
+*/
+
+/*
+** When on, one allocation in every 'interval' bytes (the one that
+** crosses the mark) is sampled: it stands for all the bytes allocated
+** since the previous sample and is charged to the current line of the
+** innermost Lua function. Sampled blocks are kept in a hash table, so
+** that frees (including those done by 'freeobj') and reallocations keep
+** the live bytes of each site up to date. The profiler memory comes
+** straight from 'frealloc' and is not seen by the collector.
+*/
+
+typedef struct AllocSite {
+  struct AllocSite *next;  /* next site in the same bucket */
+  unsigned int h;  /* hash of 'name' */
+  lu_mem live;  /* sampled bytes still allocated */
+  lu_mem total;  /* all sampled bytes */
+  lu_mem nsamples;
+  char name[1];  /* "source:line" (variable size) */
+} AllocSite;
+
+
+typedef struct Sampled {
+  struct Sampled *next;  /* next block in the same bucket */
+  void *block;
+  AllocSite *site;
+  lu_mem weight;  /* bytes this sample stands for */
+} Sampled;
+
+
+struct AllocProf {
+  size_t interval;  /* sampling interval, in bytes */
+  size_t bytes;  /* bytes allocated since the last sample */
+  AllocSite **sites;  /* hash table of sites */
+  int nsites;
+  int sitesize;
+  Sampled **blocks;  /* hash table of sampled blocks */
+  int nblocks;
+  int blocksize;
+};
+
+
+#define MINPROFSIZE	64
+
+#define rawalloc(g,s)	((*(g)->frealloc)((g)->ud, NULL, 0, (s)))
+#define rawfree(g,b,s)	((*(g)->frealloc)((g)->ud, (b), (s), 0))
+
+#define hashblock(ap,b)	\
+	lmod(point2uint(b) ^ (point2uint(b) >> 9), (ap)->blocksize)
+
+
+/*
+** Double the size of a hash table of sites or blocks (both have 'next'
+** as their first field); on failure, chains just get longer
+*/
+#define rehash(g,t,size,T,hashf)  { \
+  int ns_ = (size) * 2; \
+  T **nt_ = cast(T **, rawalloc(g, ns_ * sizeof(T *))); \
+  if (nt_ != NULL) { \
+    int i_; \
+    memset(nt_, 0, ns_ * sizeof(T *)); \
+    for (i_ = 0; i_ < (size); i_++) { \
+      T *p_ = (t)[i_]; \
+      while (p_ != NULL) { \
+        T *next_ = p_->next; \
+        unsigned int h_ = lmod(hashf(p_), ns_); \
+        p_->next = nt_[h_]; nt_[h_] = p_; \
+        p_ = next_; \
+      } \
+    } \
+    rawfree(g, (t), (size) * sizeof(T *)); \
+    (t) = nt_; (size) = ns_; \
+  } }
+
+#define sitehash(s)	((s)->h)
+#define blockhash(s)	(point2uint((s)->block) ^ (point2uint((s)->block) >> 9))
+
+
+/* size of a site name: a chunk id plus a line number */
+#define SITENAMESIZE	(LUA_IDSIZE + 16)
+
+
+/*
+** 'buff' must have SITENAMESIZE bytes. When the
+** stack itself is being moved ('block' is 'L->stack'), frames still
+** point into the old stack and must be read from the new one.
+*/
+static void sitename (lua_State *L, void *block, void *newblock,
+                      char *buff) {
+  CallInfo *ci = L->ci;
+  while (ci != NULL && !isLua(ci))  /* C functions: charge their caller */
+    ci = ci->previous;
+  if (ci == NULL)
+    strcpy(buff, "?");
+  else {
+    StkId func = ci->func;
+    Proto *p;
+    int pc;
+    size_t l;
+    if (block == cast(void *, L->stack))
+      func = cast(StkId, newblock) + (func - L->stack);
+    p = clLvalue(func)->p;
+    pc = pcRel(ci->u.l.savedpc, p);
+    luaO_chunkid(buff, p->source ? getstr(p->source) : "=?", LUA_IDSIZE);
+    l = strlen(buff);
+    l_sprintf(buff + l, SITENAMESIZE - l, ":%d", getfuncline(p, (pc < 0) ? 0 : pc));
+  }
+}
+
+
+static AllocSite *getsite (global_State *g, struct AllocProf *ap,
+                           const char *name) {
+  size_t l = strlen(name);
+  unsigned int h = luaS_hash(name, l, 0);
+  AllocSite *site;
+  for (site = ap->sites[lmod(h, ap->sitesize)]; site; site = site->next) {
+    if (site->h == h && strcmp(site->name, name) == 0)
+      return site;
+  }
+  site = cast(AllocSite *, rawalloc(g, sizeof(AllocSite) + l));
+  if (site == NULL) return NULL;
+  site->h = h;
+  site->live = site->total = site->nsamples = 0;
+  memcpy(site->name, name, l + 1);
+  site->next = ap->sites[lmod(h, ap->sitesize)];
+  ap->sites[lmod(h, ap->sitesize)] = site;
+  if (++ap->nsites > ap->sitesize)
+    rehash(g, ap->sites, ap->sitesize, AllocSite, sitehash);
+  return site;
+}
+
+
+static Sampled **findblock (struct AllocProf *ap, void *block) {
+  Sampled **p = &ap->blocks[hashblock(ap, block)];
+  while (*p != NULL && (*p)->block != block)
+    p = &(*p)->next;
+  return p;
+}
+
+
+static void sampleblock (lua_State *L, void *block, void *newblock,
+                         lu_mem weight) {
+  global_State *g = G(L);
+  struct AllocProf *ap = g->allocprof;
+  char name[SITENAMESIZE];
+  AllocSite *site;
+  Sampled *s;
+  sitename(L, block, newblock, name);
+  site = getsite(g, ap, name);
+  if (site == NULL || (s = cast(Sampled *, rawalloc(g, sizeof(Sampled)))) == NULL)
+    return;  /* no memory: lose this sample */
+  s->block = newblock;
+  s->site = site;
+  s->weight = weight;
+  s->next = ap->blocks[hashblock(ap, newblock)];
+  ap->blocks[hashblock(ap, newblock)] = s;
+  site->live += weight;
+  site->total += weight;
+  site->nsamples++;
+  if (++ap->nblocks > ap->blocksize)
+    rehash(g, ap->blocks, ap->blocksize, Sampled, blockhash);
+}
+
+
+/*
+** Keep track of a call to 'frealloc' that changed 'block' (with 'osize'
+** bytes) into 'newblock' (with 'nsize' bytes)
+*/
+static void trackalloc (lua_State *L, void *block, void *newblock,
+                        size_t osize, size_t nsize) {
+  struct AllocProf *ap = G(L)->allocprof;
+  int sampled = 0;
+  if (block != NULL) {
+    Sampled **p = findblock(ap, block);
+    Sampled *s = *p;
+    if (s != NULL) {  /* a sampled block? */
+      *p = s->next;  /* remove it */
+      if (newblock == NULL) {  /* freed? */
+        s->site->live -= s->weight;
+        rawfree(G(L), s, sizeof(Sampled));
+        ap->nblocks--;
+      }
+      else {  /* reallocated: keep the sample with its new address */
+        s->block = newblock;
+        s->next = ap->blocks[hashblock(ap, newblock)];
+        ap->blocks[hashblock(ap, newblock)] = s;
+        sampled = 1;
+      }
+    }
+  }
+  if (nsize > osize) {
+    ap->bytes += nsize - osize;
+    if (ap->bytes >= ap->interval && !sampled) {
+      sampleblock(L, block, newblock, ap->bytes);
+      ap->bytes = 0;
+    }
+  }
+}
+
+
+/*
+** Start the allocation profiler with the given interval, discarding
+** a previous profile, or stop it if 'interval' is 0
+*/
+void luaM_setprofile (lua_State *L, size_t interval) {
+  global_State *g = G(L);
+  struct AllocProf *ap = g->allocprof;
+  int i;
+  if (ap != NULL) {  /* free previous profile */
+    g->allocprof = NULL;
+    for (i = 0; i < ap->sitesize; i++) {
+      AllocSite *site = ap->sites[i];
+      while (site != NULL) {
+        AllocSite *next = site->next;
+        rawfree(g, site, sizeof(AllocSite) + strlen(site->name));
+        site = next;
+      }
+    }
+    for (i = 0; i < ap->blocksize; i++) {
+      Sampled *s = ap->blocks[i];
+      while (s != NULL) {
+        Sampled *next = s->next;
+        rawfree(g, s, sizeof(Sampled));
+        s = next;
+      }
+    }
+    rawfree(g, ap->sites, ap->sitesize * sizeof(AllocSite *));
+    rawfree(g, ap->blocks, ap->blocksize * sizeof(Sampled *));
+    rawfree(g, ap, sizeof(struct AllocProf));
+  }
+  if (interval == 0) return;
+  ap = cast(struct AllocProf *, rawalloc(g, sizeof(struct AllocProf)));
+  if (ap == NULL) luaD_throw(L, LUA_ERRMEM);
+  ap->interval = interval;
+  ap->bytes = 0;
+  ap->nsites = ap->nblocks = 0;
+  ap->sitesize = ap->blocksize = MINPROFSIZE;
+  ap->sites = cast(AllocSite **, rawalloc(g, MINPROFSIZE * sizeof(AllocSite *)));
+  ap->blocks = cast(Sampled **, rawalloc(g, MINPROFSIZE * sizeof(Sampled *)));
+  if (ap->sites == NULL || ap->blocks == NULL) {
+    rawfree(g, ap->sites, ap->sites ? MINPROFSIZE * sizeof(AllocSite *) : 0);
+    rawfree(g, ap->blocks, ap->blocks ? MINPROFSIZE * sizeof(Sampled *) : 0);
+    rawfree(g, ap, sizeof(struct AllocProf));
+    luaD_throw(L, LUA_ERRMEM);
+  }
+  memset(ap->sites, 0, MINPROFSIZE * sizeof(AllocSite *));
+  memset(ap->blocks, 0, MINPROFSIZE * sizeof(Sampled *));
+  g->allocprof = ap;
+}
+
+
+/*
+** Size of a copy of the sites made by 'luaM_copysites' (into '*sz').
+** Returns 0 if the profiler is off.
+*/
+int luaM_sitessize (lua_State *L, size_t *sz) {
+  struct AllocProf *ap = G(L)->allocprof;
+  int i;
+  AllocSite *site;
+  if (ap == NULL) return 0;
+  *sz = ap->nsites * sizeof(SiteStat);
+  for (i = 0; i < ap->sitesize; i++)
+    for (site = ap->sites[i]; site; site = site->next)
+      *sz += strlen(site->name) + 1;
+  return 1;
+}
+
+
+static int statcmp (const void *a, const void *b) {
+  const SiteStat *sa = cast(const SiteStat *, a);
+  const SiteStat *sb = cast(const SiteStat *, b);
+  if (sa->live != sb->live)
+    return (sa->live < sb->live) ? 1 : -1;  /* most live bytes first */
+  return strcmp(sa->name, sb->name);
+}
+
+
+/*
+** Copy the sites of the current profile into 'stats', which must have
+** the size given by 'luaM_sitessize', with their names after them; the
+** copy is sorted by live bytes. Returns the number of sites.
+*/
+int luaM_copysites (lua_State *L, SiteStat *stats) {
+  struct AllocProf *ap = G(L)->allocprof;
+  char *names = cast(char *, stats + ap->nsites);
+  AllocSite *site;
+  int i, n = 0;
+  for (i = 0; i < ap->sitesize; i++) {
+    for (site = ap->sites[i]; site; site = site->next) {
+      size_t l = strlen(site->name) + 1;
+      memcpy(names, site->name, l);
+      stats[n].name = names;
+      stats[n].live = site->live;
+      stats[n].total = site->total;
+      stats[n].nsamples = site->nsamples;
+      names += l;
+      n++;
+    }
+  }
+  qsort(stats, n, sizeof(SiteStat), statcmp);
+  return n;
+}
+
+/* }====================================================== */
+
+
+
 /*
 ** generic allocation routine.
 */
@@ -97,6 +412,8 @@ void *luaM_realloc_ (lua_State *L, void *block, size_t osize, size_t nsize) {
   }
   lua_assert((nsize == 0) == (newblock == NULL));
   g->GCdebt = (g->GCdebt + nsize) - realosize;    // 一个统计信息，有点增量GC的感觉。
+  if (g->allocprof != NULL)
+    trackalloc(L, block, newblock, realosize, nsize);
   return newblock;
 }
 
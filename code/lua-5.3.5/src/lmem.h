@@ -136,9 +136,20 @@
 
 LUAI_FUNC l_noret luaM_toobig (lua_State *L);
 
+
+/* a site in the copy of an allocation profile (see 'luaM_copysites') */
+typedef struct SiteStat {
+  const char *name;
+  lu_mem live, total, nsamples;
+} SiteStat;
+
+
 /* not to be called directly */
 LUAI_FUNC void *luaM_realloc_ (lua_State *L, void *block, size_t oldsize,
                                                           size_t size);
+LUAI_FUNC void luaM_setprofile (lua_State *L, size_t interval);
+LUAI_FUNC int luaM_sitessize (lua_State *L, size_t *sz);
+LUAI_FUNC int luaM_copysites (lua_State *L, SiteStat *stats);
 LUAI_FUNC void *luaM_growaux_ (lua_State *L, void *block, int *size,
                                size_t size_elem, int limit,
                                const char *what);
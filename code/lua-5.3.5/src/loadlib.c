@@ -61,6 +61,12 @@
 */
 static const int CLIBS = 0;
 
+/*
+** unique key for table in the registry that keeps the listings of
+** the directories searched by 'require'
+*/
+static const int PATHCACHE = 0;
+
 #define LIB_FAIL	"open"
 
 
@@ -421,6 +427,159 @@ static int readable (const char *filename) {
 }
 
 
+#if defined(LUA_USE_PATHCACHE)	/* { */
+
+/*
+** {======================================================
+** Directory listings for 'require': registry.PATHCACHE[dir] is the
+** set of names in directory 'dir' (with its trailing separator),
+** false if there is no such directory, or true if it cannot be
+** listed (so its files are probed with 'readable')
+** =======================================================
+*/
+
+/* results of 'listdir' */
+#define DIR_LISTED	1
+#define DIR_MISSING	0
+#define DIR_UNKNOWN	(-1)
+
+
+#if defined(LUA_USE_POSIX)	/* { */
+
+#include <dirent.h>
+#include <errno.h>
+
+#define pushname(L,s,l)		lua_pushlstring(L, s, l)
+
+/* add the names in directory 'dir' to the table on the top */
+static int listdir (lua_State *L, const char *dir) {
+  DIR *d = opendir((*dir != '\0') ? dir : ".");
+  struct dirent *e;
+  if (d == NULL)
+    return (errno == ENOENT || errno == ENOTDIR) ? DIR_MISSING : DIR_UNKNOWN;
+  while ((e = readdir(d)) != NULL) {
+    pushname(L, e->d_name, strlen(e->d_name));
+    lua_pushboolean(L, 1);
+    lua_rawset(L, -3);
+  }
+  closedir(d);
+  return DIR_LISTED;
+}
+
+#elif defined(LUA_USE_WINDOWS)	/* }{ */
+
+#include <ctype.h>
+#include <windows.h>
+
+/* Windows matches file names regardless of case */
+static void pushname (lua_State *L, const char *s, size_t l) {
+  luaL_Buffer b;
+  char *p = luaL_buffinitsize(L, &b, l);
+  size_t i;
+  for (i = 0; i < l; i++)
+    p[i] = (char)tolower((unsigned char)s[i]);
+  luaL_pushresultsize(&b, l);
+}
+
+static int listdir (lua_State *L, const char *dir) {
+  WIN32_FIND_DATAA e;
+  HANDLE h = FindFirstFileA(lua_pushfstring(L, "%s*", dir), &e);
+  lua_pop(L, 1);
+  if (h == INVALID_HANDLE_VALUE) {
+    DWORD error = GetLastError();
+    return (error == ERROR_PATH_NOT_FOUND || error == ERROR_FILE_NOT_FOUND)
+           ? DIR_MISSING : DIR_UNKNOWN;
+  }
+  do {
+    pushname(L, e.cFileName, strlen(e.cFileName));
+    lua_pushboolean(L, 1);
+    lua_rawset(L, -3);
+  } while (FindNextFileA(h, &e));
+  FindClose(h);
+  return DIR_LISTED;
+}
+
+#else				/* }{ */
+
+#define pushname(L,s,l)		lua_pushlstring(L, s, l)
+
+/* no way to list directories in ISO C */
+#define listdir(L,dir)		((void)(L), (void)(dir), DIR_UNKNOWN)
+
+#endif				/* } */
+
+
+/*
+** a directory (with its trailing separator) that is not in the listing
+** of its parent, or whose parent is missing, is missing too; this
+** spares a system call for each 'dir/?/init.lua' of a missing module
+*/
+static int unlisted (lua_State *L, int cache, const char *dir, size_t l) {
+  size_t b;
+  int res;
+  if (l < 2) return 0;  /* current or root directory */
+  for (b = l - 1; b > 0 && dir[b - 1] != '/' && dir[b - 1] != *LUA_DIRSEP; )
+    b--;  /* find start of directory name */
+  lua_pushlstring(L, dir, b);  /* parent directory */
+  if (lua_rawget(L, cache) == LUA_TTABLE) {
+    pushname(L, dir + b, l - 1 - b);
+    res = (lua_rawget(L, -2) == LUA_TNIL);
+    lua_pop(L, 1);
+  }
+  else  /* not listed yet, cannot be listed, or missing */
+    res = (lua_isboolean(L, -1) && !lua_toboolean(L, -1));
+  lua_pop(L, 1);
+  return res;
+}
+
+
+/*
+** check whether 'filename' exists by looking its name up in the
+** listing of its directory (in table at index 'cache'), which is read
+** on first use; a name found there is then opened once to be sure
+*/
+static int cachedreadable (lua_State *L, int cache, const char *filename) {
+  const char *base = filename + strlen(filename);
+  const char *dir;
+  size_t l;
+  int res;
+  while (base > filename && base[-1] != '/' && base[-1] != *LUA_DIRSEP)
+    base--;  /* find start of file name */
+  dir = lua_pushlstring(L, filename, base - filename);
+  l = base - filename;
+  lua_pushvalue(L, -1);
+  if (lua_rawget(L, cache) == LUA_TNIL) {  /* not listed yet? */
+    lua_pop(L, 1);
+    lua_newtable(L);
+    switch (unlisted(L, cache, dir, l) ? DIR_MISSING : listdir(L, dir)) {
+      case DIR_MISSING: lua_pop(L, 1); lua_pushboolean(L, 0); break;
+      case DIR_UNKNOWN: lua_pop(L, 1); lua_pushboolean(L, 1); break;
+      default: break;
+    }
+    lua_pushvalue(L, -2);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, cache);  /* PATHCACHE[dir] = listing */
+  }
+  if (lua_istable(L, -1)) {
+    pushname(L, base, strlen(base));
+    res = (lua_rawget(L, -2) != LUA_TNIL && readable(filename));
+    lua_pop(L, 1);
+  }
+  else
+    res = (lua_toboolean(L, -1) && readable(filename));
+  lua_pop(L, 2);  /* remove directory and its listing */
+  return res;
+}
+
+/* }====================================================== */
+
+#else				/* }{ */
+
+#define cachedreadable(L,c,f)	((void)(L), (void)(c), readable(f))
+
+#endif				/* } */
+
+
 static const char *pushnexttemplate (lua_State *L, const char *path) {
   const char *l;
   while (*path == *LUA_PATH_SEP) path++;  /* skip separators */
@@ -432,10 +591,16 @@ static const char *pushnexttemplate (lua_State *L, const char *path) {
 }
 
 
+/*
+** search 'name' along 'path'. With a 'cache' (a stack index, or 0 for
+** none), files are looked up in the directory listings kept there
+** instead of being probed one by one.
+*/
 static const char *searchpath (lua_State *L, const char *name,
                                              const char *path,
                                              const char *sep,
-                                             const char *dirsep) {
+                                             const char *dirsep,
+                                             int cache) {
   luaL_Buffer msg;  /* to build error message */
   luaL_buffinit(L, &msg);
   if (*sep != '\0')  /* non-empty separator? */
@@ -444,7 +609,8 @@ static const char *searchpath (lua_State *L, const char *name,
     const char *filename = luaL_gsub(L, lua_tostring(L, -1),
                                      LUA_PATH_MARK, name);
     lua_remove(L, -2);  /* remove path template */
-    if (readable(filename))  /* does file exist and is readable? */
+    if (cache ? cachedreadable(L, cache, filename)
+              : readable(filename))  /* does file exist and is readable? */
       return filename;  /* return that file name */
     lua_pushfstring(L, "\n\tno file '%s'", filename);
     lua_remove(L, -2);  /* remove file name */
@@ -459,7 +625,7 @@ static int ll_searchpath (lua_State *L) {
   const char *f = searchpath(L, luaL_checkstring(L, 1),
                                 luaL_checkstring(L, 2),
                                 luaL_optstring(L, 3, "."),
-                                luaL_optstring(L, 4, LUA_DIRSEP));
+                                luaL_optstring(L, 4, LUA_DIRSEP), 0);
   if (f != NULL) return 1;
   else {  /* error message is on top of the stack */
     lua_pushnil(L);
@@ -477,7 +643,19 @@ static const char *findfile (lua_State *L, const char *name,
   path = lua_tostring(L, -1);
   if (path == NULL)
     luaL_error(L, "'package.%s' must be a string", pname);
-  return searchpath(L, name, path, ".", dirsep);
+  lua_rawgetp(L, LUA_REGISTRYINDEX, &PATHCACHE);
+  return searchpath(L, name, path, ".", dirsep, lua_gettop(L));
+}
+
+
+/*
+** forget all directory listings; needed when files are added to or
+** removed from directories in 'package.path'/'package.cpath'
+*/
+static int ll_flushcache (lua_State *L) {
+  lua_newtable(L);
+  lua_rawsetp(L, LUA_REGISTRYINDEX, &PATHCACHE);
+  return 0;
 }
 
 
@@ -722,6 +900,7 @@ static int ll_seeall (lua_State *L) {
 static const luaL_Reg pk_funcs[] = {
   {"loadlib", ll_loadlib},
   {"searchpath", ll_searchpath},
+  {"flushcache", ll_flushcache},
 #if defined(LUA_COMPAT_MODULE)
   {"seeall", ll_seeall},
 #endif
@@ -808,6 +987,8 @@ static void createclibstable (lua_State *L) {
 */
 LUAMOD_API int luaopen_package (lua_State *L) {
   createclibstable(L);
+  lua_newtable(L);  /* create PATHCACHE table */
+  lua_rawsetp(L, LUA_REGISTRYINDEX, &PATHCACHE);
   luaL_newlib(L, pk_funcs);  /* create 'package' table */
   /**
    * table: CLIBS
@@ -110,12 +110,14 @@
 ** 0 - Lua function
 ** 1 - light C function
 ** 2 - regular C function (closure)
+** 3 - leaf light C function (see 'lua_pushleaffunction')
 */
 
 /* Variant tags for functions */
 #define LUA_TLCL	(LUA_TFUNCTION | (0 << 4))  /* Lua closure        00-0110B */
 #define LUA_TLCF	(LUA_TFUNCTION | (1 << 4))  /* light C function   01-0110B */
 #define LUA_TCCL	(LUA_TFUNCTION | (2 << 4))  /* C closure          10-0110B */
+#define LUA_TLCFL	(LUA_TFUNCTION | (3 << 4))  /* leaf light C func  11-0110B */
 
 
 /* Variant tags for strings */
@@ -263,7 +265,8 @@ typedef struct lua_TValue {
 #define ttisclosure(o)		((rttype(o) & 0x1F) == LUA_TFUNCTION)
 #define ttisCclosure(o)		checktag((o), ctb(LUA_TCCL))
 #define ttisLclosure(o)		checktag((o), ctb(LUA_TLCL))
-#define ttislcf(o)		checktag((o), LUA_TLCF)
+#define ttislcf(o)		((rttype(o) & ~(1 << 5)) == LUA_TLCF)  /* or leaf */
+#define ttisleaf(o)		checktag((o), LUA_TLCFL)
 #define ttisfulluserdata(o)	checktag((o), ctb(LUA_TUSERDATA))
 #define ttisthread(o)		checktag((o), ctb(LUA_TTHREAD))
 #define ttisdeadkey(o)		checktag((o), LUA_TDEADKEY)
@@ -322,6 +325,9 @@ typedef struct lua_TValue {
 #define setfvalue(obj,x) \
   { TValue *io=(obj); val_(io).f=(x); settt_(io, LUA_TLCF); }
 
+#define setleaffvalue(obj,x) \
+  { TValue *io=(obj); val_(io).f=(x); settt_(io, LUA_TLCFL); }
+
 #define setpvalue(obj,x) \
   { TValue *io=(obj); val_(io).p=(x); settt_(io, LUA_TLIGHTUSERDATA); }
 
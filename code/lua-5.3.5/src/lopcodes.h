@@ -230,11 +230,19 @@ OP_CLOSURE,/*	A Bx	R(A) := closure(KPROTO[Bx])			*/
 
 OP_VARARG,/*	A B	R(A), R(A+1), ..., R(A+B-2) = vararg		*/
 
-OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
+OP_EXTRAARG,/*	Ax	extra (larger) argument for previous opcode	*/
+
+/* superinstructions: created at load time and never dumped (see lopt.c) */
+OP_GETTABUP2,/*	A B C	R(A) := UpValue[B][RK(C)][Kst(C')]	(see note) */
+OP_GETTABLE2/*	A B C	R(A) := R(B)[RK(C)][Kst(C')]		(see note) */
 } OpCode;
 
 
-#define NUM_OPCODES	(cast(int, OP_EXTRAARG) + 1)
+#define NUM_OPCODES	(cast(int, OP_GETTABLE2) + 1)
+
+/* basic opcode that a superinstruction starts with */
+#define unfuseop(o)	((o) == OP_GETTABUP2 ? OP_GETTABUP : \
+			 (o) == OP_GETTABLE2 ? OP_GETTABLE : (o))
 
 
 
@@ -259,6 +267,12 @@ OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
 
   (*) All 'skips' (pc++) assume that next instruction is a jump.
 
+  (*) OP_GETTABUP2 and OP_GETTABLE2 are always followed by the
+  instruction 'GETTABLE A A C'' with a constant C'. When both lookups
+  hit without metamethods (and no line or count hook is set), the pair
+  runs in one dispatch and that instruction is skipped; otherwise only
+  the first lookup is done and the GETTABLE runs as usual.
+
 ===========================================================================*/
 
 
@@ -0,0 +1,397 @@
+/*
+** $Id: lopt.c $
+** Bytecode optimizer for finished prototypes
+** See Copyright Notice in lua.h
+*/
+
+#define lopt_c
+#define LUA_CORE
+
+#include "lprefix.h"
+
+
+#include "lua.h"
+
+#include "lmem.h"
+#include "lobject.h"
+#include "lopcodes.h"
+#include "lopt.h"
+#include "lstate.h"
+#include "lvm.h"
+
+
+/*
+** The code generator works in a single pass, so it leaves behind jumps
+** to jumps, tests whose outcome is known, no-op moves and code nobody
+** can reach. This module cleans a finished 'Proto' up: it rewrites
+** instructions in place, marks the useless ones as dead and finally
+** compacts 'code', moving 'lineinfo' along and renumbering jump offsets
+** and local-variable ranges, so all debug information stays valid.
+*/
+
+
+/* per-instruction flags */
+#define F_TARGET	1	/* some instruction may continue here */
+#define F_PINNED	2	/* position must not change (LOADBOOL skip) */
+#define F_LIVE		4	/* reachable from the entry point */
+#define F_DEAD		8	/* to be removed */
+
+
+typedef struct OptState {
+  lua_State *L;
+  Proto *f;
+  lu_byte *flags;
+} OptState;
+
+
+#define jumpdest(code,pc)	((pc) + 1 + GETARG_sBx((code)[pc]))
+
+#define isdead(os,pc)	((os)->flags[pc] & F_DEAD)
+
+
+/* mark instruction 'pc' as dead, unless its position matters */
+static int killinstr (OptState *os, int pc) {
+  if (os->flags[pc] & F_PINNED) return 0;
+  os->flags[pc] |= F_DEAD;
+  return 1;
+}
+
+
+/* recompute F_TARGET and F_PINNED */
+static void markflags (OptState *os) {
+  const Instruction *code = os->f->code;
+  int n = os->f->sizecode;
+  int pc;
+  for (pc = 0; pc < n; pc++)
+    os->flags[pc] &= ~(F_TARGET | F_PINNED);
+  for (pc = 0; pc < n; pc++) {
+    Instruction i = code[pc];
+    OpCode op = GET_OPCODE(i);
+    if (getOpMode(op) == iAsBx) {
+      os->flags[jumpdest(code, pc)] |= F_TARGET;
+    }
+    else if (op == OP_LOADBOOL && GETARG_C(i) && pc + 2 < n) {
+      os->flags[pc + 1] |= F_PINNED;
+      os->flags[pc + 2] |= F_TARGET;
+    }
+    else if (testTMode(op) && pc + 2 < n)
+      os->flags[pc + 2] |= F_TARGET;
+  }
+}
+
+
+/*
+** make jumps skip over unconditional jumps that only lead to other
+** places; a jump that closes upvalues is a real step and stops the chain
+*/
+static void threadjumps (OptState *os) {
+  Instruction *code = os->f->code;
+  int n = os->f->sizecode;
+  int pc;
+  for (pc = 0; pc < n; pc++) {
+    if (GET_OPCODE(code[pc]) == OP_JMP) {
+      int dest = jumpdest(code, pc);
+      int steps = 0;
+      while (dest < n && GET_OPCODE(code[dest]) == OP_JMP &&
+             GETARG_A(code[dest]) == 0 && steps++ < n)  /* avoid cycles */
+        dest = jumpdest(code, dest);
+      SETARG_sBx(code[pc], dest - pc - 1);
+    }
+  }
+}
+
+
+/*
+** value of the constant loaded into register 'reg' by the instruction
+** right before 'pc', or NULL if unknown
+*/
+static const TValue *loadedvalue (OptState *os, int pc, int reg, TValue *v) {
+  Instruction i;
+  if (pc == 0 || (os->flags[pc] & F_TARGET) || isdead(os, pc - 1))
+    return NULL;
+  i = os->f->code[pc - 1];
+  switch (GET_OPCODE(i)) {
+    case OP_LOADK:
+      return (GETARG_A(i) == reg) ? &os->f->k[GETARG_Bx(i)] : NULL;
+    case OP_LOADBOOL:
+      if (GETARG_A(i) != reg || GETARG_C(i)) return NULL;
+      setbvalue(v, GETARG_B(i));
+      return v;
+    case OP_LOADNIL:
+      if (reg < GETARG_A(i) || reg > GETARG_A(i) + GETARG_B(i)) return NULL;
+      setnilvalue(v);
+      return v;
+    default: return NULL;
+  }
+}
+
+
+/*
+** If the test at 'pc' has a known outcome, return whether the jump that
+** follows it is taken (1) or skipped (0); otherwise return -1.
+*/
+static int constcond (OptState *os, int pc) {
+  Instruction i = os->f->code[pc];
+  TValue v;
+  switch (GET_OPCODE(i)) {
+    case OP_EQ: case OP_LT: case OP_LE: {
+      const TValue *rb, *rc;
+      int res;
+      if (!ISK(GETARG_B(i)) || !ISK(GETARG_C(i))) return -1;
+      rb = &os->f->k[INDEXK(GETARG_B(i))];
+      rc = &os->f->k[INDEXK(GETARG_C(i))];
+      if (GET_OPCODE(i) == OP_EQ)
+        res = luaV_rawequalobj(rb, rc);
+      else if ((ttisnumber(rb) && ttisnumber(rc)) ||
+               (ttisstring(rb) && ttisstring(rc))) {  /* no metamethods */
+        res = (GET_OPCODE(i) == OP_LT) ? luaV_lessthan(os->L, rb, rc)
+                                       : luaV_lessequal(os->L, rb, rc);
+      }
+      else return -1;
+      return (res == GETARG_A(i));
+    }
+    case OP_TEST: {
+      const TValue *o = loadedvalue(os, pc, GETARG_A(i), &v);
+      if (o == NULL) return -1;
+      return ((!l_isfalse(o)) == GETARG_C(i));
+    }
+    default: return -1;
+  }
+}
+
+
+/* remove tests with a known outcome (and jumps that are never taken) */
+static void foldtests (OptState *os) {
+  int n = os->f->sizecode;
+  int pc;
+  for (pc = 0; pc + 1 < n; pc++) {
+    int taken;
+    if (isdead(os, pc) || (os->flags[pc + 1] & (F_TARGET | F_PINNED)))
+      continue;
+    taken = constcond(os, pc);
+    if (taken < 0 || !killinstr(os, pc)) continue;
+    if (!taken) killinstr(os, pc + 1);
+  }
+}
+
+
+/*
+** peephole: drop 'MOVE A A', the second of 'MOVE A B; MOVE B A', the
+** first of 'MOVE A B; MOVE A C' (A is overwritten before being read)
+** and jumps to the next instruction
+*/
+static void peephole (OptState *os) {
+  const Instruction *code = os->f->code;
+  int n = os->f->sizecode;
+  int pc;
+  for (pc = 0; pc < n; pc++) {
+    Instruction i = code[pc];
+    if (isdead(os, pc)) continue;
+    if (GET_OPCODE(i) == OP_MOVE) {
+      Instruction prev;
+      if (GETARG_A(i) == GETARG_B(i)) {
+        killinstr(os, pc);
+        continue;
+      }
+      if (pc == 0 || (os->flags[pc] & F_TARGET) || isdead(os, pc - 1))
+        continue;
+      prev = code[pc - 1];
+      if (GET_OPCODE(prev) != OP_MOVE || GETARG_A(prev) == GETARG_B(prev))
+        continue;
+      if (GETARG_A(prev) == GETARG_B(i) && GETARG_B(prev) == GETARG_A(i))
+        killinstr(os, pc);
+      else if (GETARG_A(prev) == GETARG_A(i) && GETARG_B(i) != GETARG_A(i))
+        killinstr(os, pc - 1);
+    }
+    else if (GET_OPCODE(i) == OP_JMP && GETARG_A(i) == 0 &&
+             GETARG_sBx(i) == 0) {
+      if (pc > 0 && !isdead(os, pc - 1) && testTMode(GET_OPCODE(code[pc - 1])))
+        continue;  /* jump belongs to a test */
+      killinstr(os, pc);
+    }
+  }
+}
+
+
+/* kill every instruction that cannot be reached from the entry point */
+static void removeunreachable (OptState *os) {
+  const Instruction *code = os->f->code;
+  int n = os->f->sizecode;
+  int *stack = luaM_newvector(os->L, n, int);
+  int top = 0;
+  int pc;
+#define reach(p)  \
+  { int p_ = (p); if (0 <= p_ && p_ < n && !(os->flags[p_] & F_LIVE)) \
+      { os->flags[p_] |= F_LIVE; stack[top++] = p_; } }
+  reach(0);
+  while (top > 0) {
+    Instruction i;
+    pc = stack[--top];
+    i = code[pc];
+    if (isdead(os, pc)) {  /* works as a no-op */
+      reach(pc + 1);
+      continue;
+    }
+    switch (GET_OPCODE(i)) {
+      case OP_RETURN: break;
+      case OP_JMP: case OP_FORPREP: reach(jumpdest(code, pc)); break;
+      case OP_FORLOOP: case OP_TFORLOOP:
+        reach(pc + 1); reach(jumpdest(code, pc)); break;
+      case OP_LOADBOOL:
+        reach(pc + (GETARG_C(i) ? 2 : 1)); break;
+      default:
+        reach(pc + 1);
+        if (testTMode(GET_OPCODE(i))) reach(pc + 2);
+        break;
+    }
+  }
+#undef reach
+  luaM_freearray(os->L, stack, n);
+  for (pc = 0; pc < n - 1; pc++)  /* keep final 'return' in place */
+    if (!(os->flags[pc] & F_LIVE)) killinstr(os, pc);
+}
+
+
+/*
+** remove dead instructions, fixing jumps, line info and local ranges;
+** return the number of instructions removed
+*/
+static int compact (OptState *os) {
+  lua_State *L = os->L;
+  Proto *f = os->f;
+  int n = f->sizecode;
+  int *newpc = luaM_newvector(L, n + 1, int);
+  int pc, j;
+  for (pc = 0, j = 0; pc < n; pc++) {
+    newpc[pc] = j;
+    if (!isdead(os, pc)) j++;
+  }
+  newpc[n] = j;
+  if (j < n) {
+    for (pc = 0; pc < n; pc++) {
+      Instruction i = f->code[pc];
+      if (isdead(os, pc)) continue;
+      if (getOpMode(GET_OPCODE(i)) == iAsBx)
+        SETARG_sBx(i, newpc[jumpdest(f->code, pc)] - newpc[pc] - 1);
+      f->code[newpc[pc]] = i;
+      if (f->sizelineinfo == n)
+        f->lineinfo[newpc[pc]] = f->lineinfo[pc];
+    }
+    for (pc = 0; pc < f->sizelocvars; pc++) {
+      f->locvars[pc].startpc = newpc[f->locvars[pc].startpc];
+      f->locvars[pc].endpc = newpc[f->locvars[pc].endpc];
+    }
+    if (f->sizelineinfo == n) {
+      luaM_reallocvector(L, f->lineinfo, n, j, int);
+      f->sizelineinfo = j;
+    }
+    luaM_reallocvector(L, f->code, n, j, Instruction);
+    f->sizecode = j;
+  }
+  luaM_freearray(L, newpc, n + 1);
+  return n - j;
+}
+
+
+/* check that all jumps land inside the function (loaded code is not
+   verified, and the passes index arrays with jump destinations) */
+static int checkjumps (const Proto *f) {
+  int pc;
+  for (pc = 0; pc < f->sizecode; pc++) {
+    if (getOpMode(GET_OPCODE(f->code[pc])) == iAsBx) {
+      int dest = jumpdest(f->code, pc);
+      if (dest < 0 || dest >= f->sizecode) return 0;
+    }
+  }
+  return 1;
+}
+
+
+/* maximum number of rounds over one function (each removal may expose
+   new jumps to the next instruction or new jump chains) */
+#define MAXROUNDS	4
+
+static void optimizeproto (lua_State *L, Proto *f) {
+  OptState os;
+  int round, removed;
+  if (!checkjumps(f)) return;
+  os.L = L;
+  os.f = f;
+  for (round = 0; round < MAXROUNDS; round++) {
+    int n = f->sizecode;
+    int pc;
+    os.flags = luaM_newvector(L, n, lu_byte);
+    for (pc = 0; pc < n; pc++) os.flags[pc] = 0;
+    threadjumps(&os);
+    markflags(&os);
+    foldtests(&os);
+    peephole(&os);
+    removeunreachable(&os);
+    removed = compact(&os);
+    luaM_freearray(L, os.flags, n);
+    if (removed == 0) break;
+  }
+}
+
+
+/*
+** {======================================================
+** Superinstructions
+** =======================================================
+*/
+
+/*
+** Turn 'GETTABUP A B C; GETTABLE A A K' and 'GETTABLE A B C; GETTABLE
+** A A K' into OP_GETTABUP2/OP_GETTABLE2 (chained field accesses such as
+** 'string.format' or 'self.pos.x'). The second instruction stays in the
+** code, so line info and symbolic debug information are unchanged; it
+** must not be a jump target, as the fused instruction may skip it.
+*/
+static void fuseproto (lua_State *L, Proto *f) {
+  Instruction *code = f->code;
+  int n = f->sizecode;
+  lu_byte *target;
+  int pc;
+  if (!checkjumps(f)) return;
+  target = luaM_newvector(L, n, lu_byte);
+  for (pc = 0; pc < n; pc++) target[pc] = 0;
+  for (pc = 0; pc < n; pc++)
+    if (getOpMode(GET_OPCODE(code[pc])) == iAsBx)
+      target[jumpdest(code, pc)] = 1;
+  for (pc = 0; pc + 1 < n; pc++) {
+    Instruction i = code[pc];
+    Instruction next = code[pc + 1];
+    OpCode op = GET_OPCODE(i);
+    if ((op == OP_GETTABUP || op == OP_GETTABLE) &&
+        unfuseop(GET_OPCODE(next)) == OP_GETTABLE &&
+        GETARG_A(next) == GETARG_A(i) && GETARG_B(next) == GETARG_A(i) &&
+        ISK(GETARG_C(next)) && !target[pc + 1])
+      SET_OPCODE(code[pc], (op == OP_GETTABUP) ? OP_GETTABUP2 : OP_GETTABLE2);
+  }
+  luaM_freearray(L, target, n);
+}
+
+
+void luaK_fuse (lua_State *L, Proto *f) {
+  int i;
+  if (f->sizecode > 0)
+    fuseproto(L, f);
+  for (i = 0; i < f->sizep; i++)
+    luaK_fuse(L, f->p[i]);
+}
+
+/* }====================================================== */
+
+
+/*
+** optimize 'f' and all its nested functions; the result runs the same
+** way and keeps all debug information. It is safe to call it more than
+** once on the same prototype.
+*/
+void luaK_optimize (lua_State *L, Proto *f) {
+  int i;
+  if (f->sizecode > 0)
+    optimizeproto(L, f);
+  for (i = 0; i < f->sizep; i++)
+    luaK_optimize(L, f->p[i]);
+}
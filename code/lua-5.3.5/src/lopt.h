@@ -0,0 +1,16 @@
+/*
+** $Id: lopt.h $
+** Bytecode optimizer for finished prototypes
+** See Copyright Notice in lua.h
+*/
+
+#ifndef lopt_h
+#define lopt_h
+
+#include "lobject.h"
+
+
+LUAI_FUNC void luaK_optimize (lua_State *L, Proto *f);
+LUAI_FUNC void luaK_fuse (lua_State *L, Proto *f);
+
+#endif
@@ -0,0 +1,393 @@
+/*
+** Sampling profiler library
+** See Copyright Notice in lua.h
+*/
+
+#define lprofile_c
+#define LUA_CORE
+
+#include "lprefix.h"
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "lauxlib.h"
+#include "lualib.h"
+
+#include "ldebug.h"
+#include "lgc.h"
+#include "lobject.h"
+#include "lstate.h"
+
+
+/*
+** A timer signal (SIGPROF, which counts CPU time) only arms a hook on
+** the running thread, as 'lua.c' does for interrupts. The hook takes
+** the sample outside the signal handler and removes itself, so between
+** samples the interpreter runs at full speed. A sample is the list of
+** (function, pc) pairs of the running thread, used as a key into a
+** table of counts; 'dump' resolves names only then, and prints the
+** stacks in the "collapsed" format read by flame graph tools.
+*/
+
+#if defined(LUA_USE_POSIX)	/* { */
+
+#include <signal.h>
+#include <sys/time.h>
+
+#define l_profsupported		1
+
+#else				/* }{ */
+
+#define l_profsupported		0
+
+#endif				/* } */
+
+
+/* default sampling rate (samples per second of CPU time) */
+#if !defined(LUAI_PROFHZ)
+#define LUAI_PROFHZ	1000
+#endif
+
+/* default interval of the allocation profiler, in bytes */
+#if !defined(LUAI_ALLOCINTERVAL)
+#define LUAI_ALLOCINTERVAL	(64 * 1024)
+#endif
+
+/* maximum number of frames kept per sample (the innermost ones) */
+#if !defined(LUAI_PROFDEPTH)
+#define LUAI_PROFDEPTH	64
+#endif
+
+
+/* key, in the registry, of the table with the profiler state */
+static const char *const PROFILE = "_PROFILE";
+
+/* fields of the profiler state */
+#define P_COUNTS	1	/* sample -> number of times it was taken */
+#define P_ANCHORS	2	/* Proto -> closure (keeps sampled protos alive) */
+
+
+/* one frame of a sample: a Lua function and its pc, or a C function */
+typedef struct Frame {
+  const void *f;
+  size_t pc;  /* NOPC for C functions */
+} Frame;
+
+#define NOPC	(~(size_t)0)
+
+
+/* state being profiled (only one at a time) */
+static lua_State *volatile profstate = NULL;
+
+
+#if l_profsupported	/* { */
+
+static struct sigaction oldaction;
+
+
+/*
+** Take a sample of thread 'L'; the profiler state is at the top
+*/
+static void sample (lua_State *L) {
+  Frame buff[LUAI_PROFDEPTH];
+  lua_Integer count;
+  int n = 0;
+  CallInfo *ci;
+  memset(buff, 0, sizeof(buff));  /* samples are compared as strings */
+  lua_rawgeti(L, -1, P_ANCHORS);
+  for (ci = L->ci; ci != &L->base_ci && n < LUAI_PROFDEPTH;
+                   ci = ci->previous) {
+    if (isLua(ci)) {
+      Proto *p = clLvalue(ci->func)->p;
+      buff[n].f = p;
+      buff[n].pc = cast(size_t, pcRel(ci->u.l.savedpc, p));
+      if (lua_rawgetp(L, -1, p) == LUA_TNIL) {  /* first sample of 'p'? */
+        setobj2s(L, L->top - 1, ci->func);  /* anchor its closure */
+        lua_rawsetp(L, -2, p);
+      }
+      else lua_pop(L, 1);
+    }
+    else {
+      lua_CFunction f = ttislcf(ci->func) ? fvalue(ci->func)
+                                          : clCvalue(ci->func)->f;
+      buff[n].f = cast(const void *, cast(size_t, f));
+      buff[n].pc = NOPC;
+    }
+    n++;
+  }
+  lua_pop(L, 1);  /* remove anchors */
+  lua_rawgeti(L, -1, P_COUNTS);
+  lua_pushlstring(L, cast(const char *, buff), n * sizeof(Frame));
+  lua_pushvalue(L, -1);
+  count = (lua_rawget(L, -3) == LUA_TNIL) ? 0 : lua_tointeger(L, -1);
+  lua_pop(L, 1);
+  lua_pushinteger(L, count + 1);
+  lua_rawset(L, -3);
+  lua_pop(L, 1);  /* remove counts */
+}
+
+
+static void profhook (lua_State *L, lua_Debug *ar) {
+  (void)ar;  /* not used */
+  lua_sethook(L, NULL, 0, 0);  /* one sample per tick */
+  if (lua_getfield(L, LUA_REGISTRYINDEX, PROFILE) == LUA_TTABLE)
+    sample(L);
+  lua_pop(L, 1);
+}
+
+
+/*
+** Samples are taken at the next instruction, or at the return from
+** the current (C) function, of the innermost running thread. A thread
+** with a hook of its own (e.g. from 'debug.sethook') keeps it and is
+** not sampled.
+*/
+static void profsignal (int i) {
+  lua_State *L = profstate;
+  (void)i;  /* not used */
+  if (L != NULL) {
+    lua_State *co = G(L)->running;
+    if (lua_gethook(co) == NULL)
+      lua_sethook(co, profhook, LUA_MASKRET | LUA_MASKCOUNT, 1);
+  }
+}
+
+
+static void settimer (lua_State *L, lua_Integer hz) {
+  struct itimerval tv;
+  long usec = (hz > 0) ? (long)(1000000 / hz) : 0;
+  tv.it_interval.tv_sec = usec / 1000000;
+  tv.it_interval.tv_usec = usec % 1000000;
+  tv.it_value = tv.it_interval;
+  if (setitimer(ITIMER_PROF, &tv, NULL) != 0)
+    luaL_error(L, "cannot set profiling timer");
+}
+
+
+static void startsampling (lua_State *L, lua_Integer hz) {
+  struct sigaction sa;
+  sa.sa_handler = profsignal;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  sigaction(SIGPROF, &sa, &oldaction);
+  profstate = G(L)->mainthread;
+  settimer(L, hz);
+}
+
+
+static void stopsampling (lua_State *L) {
+  settimer(L, 0);
+  sigaction(SIGPROF, &oldaction, NULL);
+  profstate = NULL;
+}
+
+#else				/* }{ */
+
+static void startsampling (lua_State *L, lua_Integer hz) {
+  (void)hz;
+  luaL_error(L, "profiler not supported");
+}
+
+
+static void stopsampling (lua_State *L) {
+  (void)L;
+}
+
+#endif				/* } */
+
+
+/*
+** stop the profiler of this state, if running
+*/
+static void stopprofile (lua_State *L) {
+  if (profstate != NULL && G(profstate) == G(L))
+    stopsampling(L);
+}
+
+
+/*
+** finalizer of the profiler state: stops sampling when the state is
+** closed, unless a newer profile replaced this one
+*/
+static int prof_gc (lua_State *L) {
+  lua_getfield(L, LUA_REGISTRYINDEX, PROFILE);
+  if (lua_rawequal(L, 1, -1))
+    stopprofile(L);
+  return 0;
+}
+
+
+static int prof_start (lua_State *L) {
+  lua_Integer hz = luaL_optinteger(L, 1, LUAI_PROFHZ);
+  luaL_argcheck(L, 0 < hz && hz <= 1000000, 1, "rate out of range");
+  if (profstate != NULL)
+    return luaL_error(L, "profiler already running");
+  lua_createtable(L, 2, 0);  /* new profiler state */
+  lua_newtable(L);
+  lua_rawseti(L, -2, P_COUNTS);
+  lua_newtable(L);
+  lua_rawseti(L, -2, P_ANCHORS);
+  lua_createtable(L, 0, 1);  /* its metatable */
+  lua_pushcfunction(L, prof_gc);
+  lua_setfield(L, -2, "__gc");
+  lua_setmetatable(L, -2);
+  lua_setfield(L, LUA_REGISTRYINDEX, PROFILE);
+  startsampling(L, hz);
+  return 0;
+}
+
+
+static int prof_stop (lua_State *L) {
+  stopprofile(L);
+  return 0;
+}
+
+
+/*
+** add to buffer the name of frame 'k' of a sample with 'n' frames
+*/
+static void addframe (luaL_Buffer *b, const Frame *fr, int k, int n) {
+  lua_State *L = b->L;
+  const char *name = NULL;
+  if (k + 1 < n && fr[k + 1].pc != NOPC) {  /* called from Lua? */
+    if (luaG_callname(cast(Proto *, fr[k + 1].f),
+                      cast_int(fr[k + 1].pc), &name) == NULL)
+      name = NULL;
+  }
+  if (fr[k].pc == NOPC)  /* C function? */
+    lua_pushfstring(L, "%s [C]", name ? name : "?");
+  else {
+    const Proto *p = cast(const Proto *, fr[k].f);
+    char src[LUA_IDSIZE];
+    luaO_chunkid(src, p->source ? getstr(p->source) : "=?", LUA_IDSIZE);
+    if (p->linedefined == 0)
+      lua_pushfstring(L, "main chunk (%s)", src);
+    else if (name)
+      lua_pushfstring(L, "%s (%s:%d)", name, src, p->linedefined);
+    else
+      lua_pushfstring(L, "%s:%d", src, p->linedefined);
+  }
+  luaL_addvalue(b);
+}
+
+
+static int linecmp (const void *a, const void *b) {
+  return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+
+/*
+** Returns the samples in "collapsed" format (one line per distinct
+** stack, outermost frame first, followed by its count) and the total
+** number of samples
+*/
+static int prof_dump (lua_State *L) {
+  lua_Integer total = 0;
+  int nlines = 0;
+  int agg, i;
+  const char **lines;
+  luaL_Buffer b;
+  if (lua_getfield(L, LUA_REGISTRYINDEX, PROFILE) != LUA_TTABLE)
+    return luaL_error(L, "no profile");
+  lua_rawgeti(L, -1, P_COUNTS);
+  lua_newtable(L);  /* stack line -> count */
+  agg = lua_gettop(L);
+  lua_pushnil(L);
+  while (lua_next(L, agg - 1)) {
+    size_t len;
+    const Frame *fr = cast(const Frame *, lua_tolstring(L, -2, &len));
+    int n = cast_int(len / sizeof(Frame));
+    lua_Integer count = lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    luaL_buffinit(L, &b);
+    for (i = n - 1; i >= 0; i--) {
+      addframe(&b, fr, i, n);
+      if (i > 0) luaL_addchar(&b, ';');
+    }
+    luaL_pushresult(&b);
+    lua_pushvalue(L, -1);
+    if (lua_rawget(L, agg) == LUA_TNIL) nlines++;
+    count += lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    lua_pushinteger(L, count);
+    lua_rawset(L, agg);
+  }
+  /* sort lines, so that equal profiles give equal dumps */
+  lines = cast(const char **, lua_newuserdata(L, nlines * sizeof(char *) + 1));
+  i = 0;
+  lua_pushnil(L);
+  while (lua_next(L, agg)) {
+    lines[i++] = lua_tostring(L, -2);
+    lua_pop(L, 1);
+  }
+  qsort(lines, nlines, sizeof(char *), linecmp);
+  luaL_buffinit(L, &b);
+  for (i = 0; i < nlines; i++) {
+    lua_Integer count;
+    lua_getfield(L, agg, lines[i]);
+    count = lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    total += count;
+    luaL_addstring(&b, lines[i]);
+    lua_pushfstring(L, " %I\n", (LUAI_UACINT)count);
+    luaL_addvalue(&b);
+  }
+  luaL_pushresult(&b);
+  lua_pushinteger(L, total);
+  return 2;
+}
+
+
+/*
+** {======================================================
+** Allocation profiler (see 'lua_allocprofile')
+** =======================================================
+*/
+
+static int prof_allocstart (lua_State *L) {
+  lua_Integer interval = luaL_optinteger(L, 1, LUAI_ALLOCINTERVAL);
+  luaL_argcheck(L, interval > 0, 1, "interval must be positive");
+  lua_allocprofile(L, (size_t)interval);
+  return 0;
+}
+
+
+static int prof_allocstop (lua_State *L) {
+  lua_allocprofile(L, 0);
+  return 0;
+}
+
+
+/*
+** Returns the allocation sites of the running profile, sorted by the
+** (estimated) bytes they allocated that are still alive
+*/
+static int prof_allocs (lua_State *L) {
+  if (!lua_allocsites(L))
+    return luaL_error(L, "allocation profiler is not running");
+  return 1;
+}
+
+/* }====================================================== */
+
+
+static const luaL_Reg prof_funcs[] = {
+  {"start", prof_start},
+  {"stop", prof_stop},
+  {"dump", prof_dump},
+  {"allocstart", prof_allocstart},
+  {"allocstop", prof_allocstop},
+  {"allocs", prof_allocs},
+  {NULL, NULL}
+};
+
+
+LUAMOD_API int luaopen_profile (lua_State *L) {
+  luaL_newlib(L, prof_funcs);
+  return 1;
+}
+
@@ -0,0 +1,640 @@
+/*
+** Cooperative task scheduler library
+** See Copyright Notice in lua.h
+*/
+
+#define lschedlib_c
+#define LUA_LIB
+
+#include "lprefix.h"
+
+
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+
+#include "lua.h"
+
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+/*
+** Tasks are coroutines run by 'sched.run', which resumes them directly
+** with 'lua_resume'. Blocking operations record why the running task
+** stops (a timer, a channel, another task) and yield with no values;
+** whoever wakes it up pushes into its stack the values it resumes with,
+** which become the results of the operation. Ready tasks form a FIFO
+** list and sleeping ones a binary heap ordered by wake-up time, both
+** linked through the tasks themselves, so a switch allocates nothing.
+*/
+
+
+/* clock for timers, in seconds */
+#if !defined(l_now)		/* { */
+
+#if defined(LUA_USE_POSIX)	/* { */
+
+#include <errno.h>
+
+static lua_Number l_now (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (lua_Number)ts.tv_sec + (lua_Number)ts.tv_nsec * 1e-9;
+}
+
+static void l_sleep (lua_Number s) {
+  struct timespec ts;
+  ts.tv_sec = (time_t)s;
+  ts.tv_nsec = (long)((s - (lua_Number)ts.tv_sec) * 1e9);
+  while (nanosleep(&ts, &ts) != 0 && errno == EINTR) ;
+}
+
+#else				/* }{ */
+
+/* ISO C: processor time, waiting in a busy loop */
+#define l_now()		((lua_Number)clock() / (lua_Number)CLOCKS_PER_SEC)
+#define l_sleep(s)	((void)(s))
+
+#endif				/* } */
+
+#endif				/* } */
+
+
+#define TASK		"sched.task"
+#define CHANNEL		"sched.channel"
+
+/* upvalues of all functions */
+#define SCHED		lua_upvalueindex(1)  /* the scheduler */
+#define TASKS		lua_upvalueindex(2)  /* tasks alive, by reference */
+#define VALUES		lua_upvalueindex(3)  /* values of blocked senders */
+
+
+enum { T_READY, T_RUNNING, T_SLEEPING, T_BLOCKED, T_DEAD, T_FAILED };
+
+static const char *const statusnames[] = {
+  "ready", "running", "sleeping", "blocked", "dead", "failed"
+};
+
+
+struct Task;
+
+typedef struct Queue {
+  struct Task *head, *tail;
+} Queue;
+
+
+typedef struct Task {
+  lua_State *co;
+  struct Task *next;  /* in the ready queue or in a wait queue */
+  Queue joiners;  /* tasks waiting for this one to finish */
+  lua_Number wake;  /* time to wake up, when sleeping */
+  unsigned long seq;  /* order among equal wake-up times */
+  int status;
+  int nargs;  /* number of values to resume it with */
+  int ref;  /* reference in TASKS (LUA_NOREF when finished) */
+} Task;
+
+
+typedef struct Channel {
+  int capacity;
+  int count;  /* number of buffered values */
+  int head;  /* index of the first one */
+  int closed;
+  Queue senders;  /* tasks waiting for room */
+  Queue receivers;  /* tasks waiting for values */
+} Channel;
+
+
+typedef struct Sched {
+  Queue ready;
+  Task **heap;  /* sleeping tasks */
+  int nheap;
+  int sizeheap;
+  unsigned long seq;
+  Task *current;  /* running task */
+  int running;  /* inside 'sched.run'? */
+  int alive;  /* number of tasks not finished */
+} Sched;
+
+
+static void enqueue (Queue *q, Task *t) {
+  t->next = NULL;
+  if (q->tail == NULL) q->head = t;
+  else q->tail->next = t;
+  q->tail = t;
+}
+
+
+static Task *dequeue (Queue *q) {
+  Task *t = q->head;
+  if (t != NULL) {
+    q->head = t->next;
+    if (q->head == NULL) q->tail = NULL;
+  }
+  return t;
+}
+
+
+static void makeready (Sched *S, Task *t) {
+  t->status = T_READY;
+  enqueue(&S->ready, t);
+}
+
+
+/*
+** Wake up task 't' with the value at the top of the stack of 'L' as
+** the result of the operation where it blocked
+*/
+static void wakewith (lua_State *L, Sched *S, Task *t) {
+  lua_xmove(L, t->co, 1);
+  t->nargs = 1;
+  makeready(S, t);
+}
+
+
+/*
+** {======================================================
+** Timer heap
+** =======================================================
+*/
+
+static int earlier (const Task *a, const Task *b) {
+  return (a->wake < b->wake) || (a->wake == b->wake && a->seq < b->seq);
+}
+
+
+static void heappush (lua_State *L, Sched *S, Task *t) {
+  int i;
+  if (S->nheap == S->sizeheap) {  /* grow heap */
+    void *ud;
+    lua_Alloc allocf = lua_getallocf(L, &ud);
+    int newsize = (S->sizeheap > 0) ? 2 * S->sizeheap : 64;
+    Task **h = (Task **)allocf(ud, S->heap, S->sizeheap * sizeof(Task *),
+                                            newsize * sizeof(Task *));
+    if (h == NULL) luaL_error(L, "not enough memory");
+    S->heap = h;
+    S->sizeheap = newsize;
+  }
+  t->seq = S->seq++;
+  for (i = S->nheap++; i > 0 && earlier(t, S->heap[(i - 1) / 2]);
+       i = (i - 1) / 2)
+    S->heap[i] = S->heap[(i - 1) / 2];  /* move parent down */
+  S->heap[i] = t;
+}
+
+
+static Task *heappop (Sched *S) {
+  Task *top = S->heap[0];
+  Task *last = S->heap[--S->nheap];
+  int i = 0;
+  for (;;) {
+    int c = 2 * i + 1;
+    if (c >= S->nheap) break;
+    if (c + 1 < S->nheap && earlier(S->heap[c + 1], S->heap[c]))
+      c++;
+    if (!earlier(S->heap[c], last)) break;
+    S->heap[i] = S->heap[c];  /* move child up */
+    i = c;
+  }
+  S->heap[i] = last;
+  return top;
+}
+
+
+/*
+** Move tasks whose time has come to the ready queue; returns the time
+** to wait for the next one (0 if some task is ready)
+*/
+static lua_Number wakeup (Sched *S) {
+  lua_Number now = l_now();
+  while (S->nheap > 0 && S->heap[0]->wake <= now)
+    makeready(S, heappop(S));
+  if (S->ready.head != NULL || S->nheap == 0) return 0;
+  else return S->heap[0]->wake - now;
+}
+
+/* }====================================================== */
+
+
+static Sched *tosched (lua_State *L) {
+  return (Sched *)lua_touserdata(L, SCHED);
+}
+
+
+/*
+** The running task, which must be the caller and able to yield: it is
+** checked before the task is put in any queue, so that a failed
+** 'lua_yield' (which a 'pcall' in the task may catch) leaves none behind
+*/
+static Task *current (lua_State *L, Sched *S, const char *op) {
+  Task *t = S->current;
+  if (t == NULL || t->co != L)
+    luaL_error(L, "cannot %s outside a task", op);
+  if (!lua_isyieldable(L))
+    luaL_error(L, "cannot %s across a C-call boundary", op);
+  return t;
+}
+
+
+static Task *checktask (lua_State *L, int arg) {
+  return (Task *)luaL_checkudata(L, arg, TASK);
+}
+
+
+/*
+** Push the results of finished task 't' into 'L': true plus the values
+** its function returned, or false plus its error; returns their number
+*/
+static int pushresults (lua_State *L, Task *t) {
+  int top = lua_gettop(t->co);
+  int n = (t->status == T_DEAD) ? top : 1;  /* all results or the error */
+  int i;
+  if (!lua_checkstack(L, n + 1) || !lua_checkstack(t->co, n)) {
+    lua_pushboolean(L, 0);  /* ('L' may be a suspended task: no errors) */
+    lua_pushliteral(L, "too many results");
+    return 2;
+  }
+  lua_pushboolean(L, t->status == T_DEAD);
+  for (i = top - n + 1; i <= top; i++)
+    lua_pushvalue(t->co, i);
+  lua_xmove(t->co, L, n);
+  return n + 1;
+}
+
+
+/*
+** Task 't' returned (or raised an error): wake up its joiners and
+** release it. An error that no task joins is raised in 'sched.run'.
+*/
+static void finish (lua_State *L, Sched *S, Task *t, int status) {
+  Task *j;
+  int joined = (t->joiners.head != NULL);
+  t->status = (status == LUA_OK) ? T_DEAD : T_FAILED;
+  while ((j = dequeue(&t->joiners)) != NULL) {
+    j->nargs = pushresults(j->co, t);
+    makeready(S, j);
+  }
+  luaL_unref(L, TASKS, t->ref);
+  t->ref = LUA_NOREF;
+  S->alive--;
+  if (t->status == T_FAILED && !joined) {
+    S->running = 0;
+    luaL_checkstack(L, 1, "too many results");
+    if (lua_checkstack(t->co, 1))  /* keep it there for later joins */
+      lua_pushvalue(t->co, -1);  /* error object */
+    lua_xmove(t->co, L, 1);
+    lua_error(L);
+  }
+}
+
+
+static void resume (lua_State *L, Sched *S, Task *t) {
+  int status;
+  int nargs = t->nargs;
+  t->nargs = 0;
+  t->status = T_RUNNING;
+  S->current = t;
+  status = lua_resume(t->co, L, nargs);
+  S->current = NULL;
+  if (status == LUA_YIELD) {
+    lua_settop(t->co, 0);  /* discard yielded values */
+    if (t->status == T_RUNNING)  /* a plain 'coroutine.yield'? */
+      makeready(S, t);
+  }
+  else
+    finish(L, S, t, status);
+}
+
+
+/*
+** sched.run(): runs tasks until none is ready or sleeping; returns
+** the number of tasks left blocked
+*/
+static int sched_run (lua_State *L) {
+  Sched *S = tosched(L);
+  if (S->running)
+    return luaL_error(L, "scheduler already running");
+  S->running = 1;
+  for (;;) {
+    Task *t;
+    if (S->nheap > 0) {
+      lua_Number wait = wakeup(S);
+      if (wait > 0) {  /* nothing to do until next timer */
+        l_sleep(wait);
+        continue;
+      }
+    }
+    if ((t = dequeue(&S->ready)) == NULL)
+      break;
+    resume(L, S, t);
+  }
+  S->running = 0;
+  lua_pushinteger(L, S->alive);
+  return 1;
+}
+
+
+/*
+** sched.spawn(f, ...): new task to call 'f' with the given arguments
+*/
+static int sched_spawn (lua_State *L) {
+  Sched *S = tosched(L);
+  int n = lua_gettop(L);
+  int i;
+  Task *t;
+  lua_State *co;
+  luaL_checktype(L, 1, LUA_TFUNCTION);
+  t = (Task *)lua_newuserdata(L, sizeof(Task));
+  memset(t, 0, sizeof(Task));
+  t->ref = LUA_NOREF;
+  luaL_setmetatable(L, TASK);
+  co = lua_newthread(L);
+  lua_setuservalue(L, -2);  /* task keeps its coroutine */
+  lua_checkstack(co, n);
+  for (i = 1; i <= n; i++)  /* move function and arguments */
+    lua_pushvalue(L, i);
+  lua_xmove(L, co, n);
+  t->co = co;
+  t->nargs = n - 1;
+  lua_pushvalue(L, -1);
+  t->ref = luaL_ref(L, TASKS);  /* keep it alive until it finishes */
+  S->alive++;
+  makeready(S, t);
+  return 1;
+}
+
+
+static int sched_yield (lua_State *L) {
+  Sched *S = tosched(L);
+  makeready(S, current(L, S, "yield"));
+  return lua_yield(L, 0);
+}
+
+
+static int sched_sleep (lua_State *L) {
+  Sched *S = tosched(L);
+  Task *t = current(L, S, "sleep");
+  lua_Number d = luaL_checknumber(L, 1);
+  if (d <= 0) {
+    makeready(S, t);
+    return lua_yield(L, 0);
+  }
+  t->wake = l_now() + d;
+  heappush(L, S, t);
+  t->status = T_SLEEPING;
+  return lua_yield(L, 0);
+}
+
+
+/*
+** sched.join(t): waits for task 't' to finish; returns true plus its
+** results, or false plus its error (as 'pcall')
+*/
+static int sched_join (lua_State *L) {
+  Sched *S = tosched(L);
+  Task *t = checktask(L, 1);
+  Task *c;
+  if (t->status == T_DEAD || t->status == T_FAILED)
+    return pushresults(L, t);
+  c = current(L, S, "join");
+  luaL_argcheck(L, t != c, 1, "task cannot join itself");
+  c->status = T_BLOCKED;
+  enqueue(&t->joiners, c);
+  return lua_yield(L, 0);
+}
+
+
+static int sched_status (lua_State *L) {
+  lua_pushstring(L, statusnames[checktask(L, 1)->status]);
+  return 1;
+}
+
+
+static int sched_self (lua_State *L) {
+  Task *t = tosched(L)->current;
+  if (t != NULL && t->co == L)
+    lua_rawgeti(L, TASKS, t->ref);
+  else
+    lua_pushnil(L);
+  return 1;
+}
+
+
+static int sched_now (lua_State *L) {
+  lua_pushnumber(L, l_now());
+  return 1;
+}
+
+
+static int task_tostring (lua_State *L) {
+  Task *t = checktask(L, 1);
+  lua_pushfstring(L, "task (%s): %p", statusnames[t->status], (void *)t);
+  return 1;
+}
+
+
+/*
+** {======================================================
+** Channels
+** =======================================================
+*/
+
+static Channel *tochannel (lua_State *L) {
+  return (Channel *)luaL_checkudata(L, 1, CHANNEL);
+}
+
+
+/*
+** sched.channel([capacity]): new channel buffering up to 'capacity'
+** values (default 1)
+*/
+static int sched_channel (lua_State *L) {
+  lua_Integer cap = luaL_optinteger(L, 1, 1);
+  Channel *ch;
+  luaL_argcheck(L, 0 < cap && cap <= INT_MAX, 1, "capacity out of range");
+  ch = (Channel *)lua_newuserdata(L, sizeof(Channel));
+  memset(ch, 0, sizeof(Channel));
+  ch->capacity = (int)cap;
+  luaL_setmetatable(L, CHANNEL);
+  lua_createtable(L, (cap <= 1024) ? (int)cap : 1024, 0);  /* buffer */
+  lua_setuservalue(L, -2);
+  return 1;
+}
+
+
+/*
+** ch:send(v): returns true when 'v' is buffered or delivered, false if
+** the channel is closed; blocks while the channel is full
+*/
+static int ch_send (lua_State *L) {
+  Sched *S = tosched(L);
+  Channel *ch = tochannel(L);
+  Task *r, *c;
+  luaL_argcheck(L, !lua_isnoneornil(L, 2), 2, "value expected");
+  lua_settop(L, 2);
+  if (ch->closed) {
+    lua_pushboolean(L, 0);
+    return 1;
+  }
+  if ((r = dequeue(&ch->receivers)) != NULL) {  /* someone waiting? */
+    wakewith(L, S, r);  /* give it the value */
+    lua_pushboolean(L, 1);
+    return 1;
+  }
+  if (ch->count < ch->capacity) {  /* room in the buffer? */
+    lua_getuservalue(L, 1);
+    lua_pushvalue(L, 2);
+    lua_rawseti(L, -2, (ch->head + ch->count++) % ch->capacity + 1);
+    lua_pushboolean(L, 1);
+    return 1;
+  }
+  c = current(L, S, "block");
+  lua_pushvalue(L, 2);
+  lua_rawseti(L, VALUES, c->ref);  /* keep value until there is room */
+  c->status = T_BLOCKED;
+  enqueue(&ch->senders, c);
+  return lua_yield(L, 0);
+}
+
+
+/*
+** ch:recv(): returns the next value, or nil if the channel is closed
+** and empty; blocks while the channel is empty
+*/
+static int ch_recv (lua_State *L) {
+  Sched *S = tosched(L);
+  Channel *ch = tochannel(L);
+  Task *c;
+  if (ch->count > 0) {
+    Task *s;
+    int slot = ch->head + 1;
+    lua_getuservalue(L, 1);
+    lua_rawgeti(L, -1, slot);  /* result */
+    lua_pushnil(L);
+    lua_rawseti(L, -3, slot);
+    ch->head = (ch->head + 1) % ch->capacity;
+    ch->count--;
+    if ((s = dequeue(&ch->senders)) != NULL) {  /* a sender can go on */
+      lua_rawgeti(L, VALUES, s->ref);
+      lua_rawseti(L, -3, (ch->head + ch->count++) % ch->capacity + 1);
+      lua_pushnil(L);
+      lua_rawseti(L, VALUES, s->ref);
+      lua_pushboolean(L, 1);
+      wakewith(L, S, s);
+    }
+    return 1;
+  }
+  if (ch->closed) {
+    lua_pushnil(L);
+    return 1;
+  }
+  c = current(L, S, "block");
+  c->status = T_BLOCKED;
+  enqueue(&ch->receivers, c);
+  return lua_yield(L, 0);
+}
+
+
+/*
+** ch:close(): no more values can be sent; tasks waiting to receive get
+** nil and tasks waiting to send get false
+*/
+static int ch_close (lua_State *L) {
+  Sched *S = tosched(L);
+  Channel *ch = tochannel(L);
+  Task *t;
+  ch->closed = 1;
+  while ((t = dequeue(&ch->receivers)) != NULL) {
+    lua_pushnil(L);
+    wakewith(L, S, t);
+  }
+  while ((t = dequeue(&ch->senders)) != NULL) {
+    lua_pushnil(L);
+    lua_rawseti(L, VALUES, t->ref);
+    lua_pushboolean(L, 0);
+    wakewith(L, S, t);
+  }
+  return 0;
+}
+
+
+static int ch_len (lua_State *L) {
+  lua_pushinteger(L, tochannel(L)->count);
+  return 1;
+}
+
+/* }====================================================== */
+
+
+static int sched_gc (lua_State *L) {
+  Sched *S = (Sched *)lua_touserdata(L, 1);
+  void *ud;
+  lua_Alloc allocf = lua_getallocf(L, &ud);
+  allocf(ud, S->heap, S->sizeheap * sizeof(Task *), 0);
+  S->heap = NULL;
+  S->nheap = S->sizeheap = 0;
+  return 0;
+}
+
+
+static const luaL_Reg sched_funcs[] = {
+  {"channel", sched_channel},
+  {"join", sched_join},
+  {"now", sched_now},
+  {"run", sched_run},
+  {"self", sched_self},
+  {"sleep", sched_sleep},
+  {"spawn", sched_spawn},
+  {"status", sched_status},
+  {"yield", sched_yield},
+  {NULL, NULL}
+};
+
+
+static const luaL_Reg ch_methods[] = {
+  {"close", ch_close},
+  {"recv", ch_recv},
+  {"send", ch_send},
+  {"__len", ch_len},
+  {NULL, NULL}
+};
+
+
+/*
+** push the upvalues shared by all functions
+*/
+static void pushupvalues (lua_State *L, int base) {
+  lua_pushvalue(L, base);
+  lua_pushvalue(L, base + 1);
+  lua_pushvalue(L, base + 2);
+}
+
+
+LUAMOD_API int luaopen_sched (lua_State *L) {
+  int base;
+  Sched *S = (Sched *)lua_newuserdata(L, sizeof(Sched));
+  memset(S, 0, sizeof(Sched));
+  base = lua_gettop(L);
+  lua_createtable(L, 0, 1);  /* metatable for the scheduler */
+  lua_pushcfunction(L, sched_gc);
+  lua_setfield(L, -2, "__gc");
+  lua_setmetatable(L, base);
+  lua_newtable(L);  /* TASKS */
+  lua_newtable(L);  /* VALUES */
+  luaL_newmetatable(L, TASK);
+  lua_pushcfunction(L, task_tostring);
+  lua_setfield(L, -2, "__tostring");
+  lua_pop(L, 1);
+  luaL_newmetatable(L, CHANNEL);
+  pushupvalues(L, base);
+  luaL_setfuncs(L, ch_methods, 3);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+  luaL_newlibtable(L, sched_funcs);
+  pushupvalues(L, base);
+  luaL_setfuncs(L, sched_funcs, 3);
+  return 1;
+}
+
@@ -0,0 +1,525 @@
+/*
+** Serialization library
+** See Copyright Notice in lua.h
+*/
+
+#define lserlib_c
+#define LUA_CORE
+
+#include "lprefix.h"
+
+
+#include <limits.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "lauxlib.h"
+#include "lualib.h"
+
+#include "lapi.h"
+#include "lgc.h"
+#include "lobject.h"
+#include "lstate.h"
+#include "ltable.h"
+
+
+/*
+** 'encode' turns a value (nil, boolean, number, string, or a table
+** of those) into a string, which 'decode' turns back into an equal
+** value. Tables are written as the sizes of their array and hash
+** parts, so that 'decode' can presize them, followed by the contents
+** of each part. Each table and each string (of two or more bytes) is
+** written once; later occurrences are written as its index among the
+** ones already seen, which keeps shared tables shared, allows cycles,
+** and writes repeated keys only once. Both sides number them in the
+** same order (tables when they start, strings when they are first
+** seen), so the indices are not written. Integers and lengths are
+** variable-length; floats use the native format of 'lua_Number'.
+*/
+
+
+/* maximum nesting of tables */
+#if !defined(LUAI_SERDEPTH)
+#define LUAI_SERDEPTH		1000
+#endif
+
+
+/* tags */
+enum {
+  T_NIL, T_FALSE, T_TRUE,
+  T_INT,  /* zigzag varint */
+  T_FLOAT,  /* raw lua_Number */
+  T_STRING,  /* varint length + bytes */
+  T_STRREF,  /* varint index of a string already seen */
+  T_TABLE,  /* varint array size + varint hash size + contents */
+  T_TABREF  /* varint index of a table already seen */
+};
+
+#define T_SHORTSTR	0x40	/* + length (< 64) + bytes */
+#define T_SMALLINT	0x80	/* + value (< 128) */
+
+#define MAXSHORTSTR	0x3f
+#define MAXSMALLINT	0x7f
+
+/* strings shorter than that are not numbered (a reference is as big) */
+#define MINREF		2
+
+/* maximum size of a varint */
+#define MAXVARINT	((sizeof(lua_Unsigned) * 8 + 6) / 7)
+
+
+/*
+** {======================================================
+** Encoder
+** =======================================================
+*/
+
+/*
+** The encoder walks the tables directly, without calling metamethods
+** or changing them; each table being walked is kept in the stack, as
+** it could otherwise be collected (from a weak table) while the buffer
+** grows. Values already seen are kept in an open-addressing table
+** keyed by their addresses: short strings are internalized, so equal
+** ones are the same object; equal long strings that are not are just
+** written again.
+*/
+
+typedef struct SeenEntry {
+  const void *p;
+  lua_Integer i;
+} SeenEntry;
+
+
+typedef struct Encoder {
+  lua_State *L;
+  luaL_Buffer b;
+  int box;  /* stack slot for the box of 'b' */
+  int slot;  /* stack slot of the userdata with 'seen' */
+  SeenEntry *seen;  /* entries of the table of values seen */
+  size_t size, n;  /* size of 'seen' (a power of 2), entries in use */
+  lua_Integer nstr, ntab;  /* number of strings/tables seen */
+} Encoder;
+
+
+#define hashptr(p)	((size_t)(p) >> 4)
+
+
+static void growseen (Encoder *E) {
+  size_t i, oldsize = E->size;
+  size_t newsize = (oldsize == 0) ? 64 : oldsize * 2;
+  SeenEntry *old = E->seen;
+  SeenEntry *e;
+  if (newsize > MAX_SIZE / sizeof(SeenEntry))
+    luaL_error(E->L, "too many values to serialize");
+  e = (SeenEntry *)lua_newuserdata(E->L, newsize * sizeof(SeenEntry));
+  memset(e, 0, newsize * sizeof(SeenEntry));
+  for (i = 0; i < oldsize; i++) {
+    if (old[i].p != NULL) {
+      size_t h = hashptr(old[i].p) & (newsize - 1);
+      while (e[h].p != NULL) h = (h + 1) & (newsize - 1);
+      e[h] = old[i];
+    }
+  }
+  lua_replace(E->L, E->slot);  /* old one can be collected */
+  E->seen = e;
+  E->size = newsize;
+}
+
+
+/*
+** Look 'p' up in the table of values already seen; if it is new,
+** gives it index 'n' + 1 and returns 0
+*/
+static lua_Integer lookup (Encoder *E, const void *p, lua_Integer n) {
+  size_t h;
+  if (2 * (E->n + 1) > E->size)
+    growseen(E);
+  h = hashptr(p) & (E->size - 1);
+  while (E->seen[h].p != NULL) {
+    if (E->seen[h].p == p)
+      return E->seen[h].i;
+    h = (h + 1) & (E->size - 1);
+  }
+  E->seen[h].p = p;
+  E->seen[h].i = n + 1;
+  E->n++;
+  return 0;
+}
+
+
+/*
+** As the stack is in use, the box of the buffer (created by its first
+** growth, at the top) is moved to a fixed slot, and brought back to the
+** top only to grow again
+*/
+static void growbuff (Encoder *E, size_t sz) {
+  luaL_Buffer *B = &E->b;
+  if (B->b != B->initb) {  /* box already exists? */
+    lua_pushvalue(E->L, E->box);
+    luaL_prepbuffsize(B, sz);
+    lua_pop(E->L, 1);
+  }
+  else {
+    luaL_prepbuffsize(B, sz);
+    lua_replace(E->L, E->box);
+  }
+}
+
+
+#define prepbuff(E,sz) \
+  ((E)->b.size - (E)->b.n < (sz) ? growbuff(E, sz) : (void)0, \
+   (E)->b.b + (E)->b.n)
+
+#define addsize(E,sz)	((E)->b.n += (sz))
+
+
+static void addtag (Encoder *E, int tag) {
+  *prepbuff(E, 1) = (char)tag;
+  addsize(E, 1);
+}
+
+
+static size_t putvarint (char *p, lua_Unsigned x) {
+  size_t n = 0;
+  while (x >= 0x80) {
+    p[n++] = (char)((x & 0x7f) | 0x80);
+    x >>= 7;
+  }
+  p[n++] = (char)x;
+  return n;
+}
+
+
+static void addheader (Encoder *E, int tag, lua_Unsigned x) {
+  char *p = prepbuff(E, 1 + MAXVARINT);
+  p[0] = (char)tag;
+  addsize(E, 1 + putvarint(p + 1, x));
+}
+
+
+static void encstring (Encoder *E, TString *ts) {
+  size_t l = tsslen(ts);
+  char *p;
+  if (l >= MINREF) {
+    lua_Integer i = lookup(E, ts, E->nstr);
+    if (i != 0) {
+      addheader(E, T_STRREF, (lua_Unsigned)i);
+      return;
+    }
+    E->nstr++;
+  }
+  if (l <= MAXSHORTSTR) {
+    p = prepbuff(E, 1 + l);
+    *p = (char)(T_SHORTSTR + l);
+    memcpy(p + 1, getstr(ts), l);
+    addsize(E, 1 + l);
+  }
+  else {
+    addheader(E, T_STRING, (lua_Unsigned)l);
+    memcpy(prepbuff(E, l), getstr(ts), l);
+    addsize(E, l);
+  }
+}
+
+
+static void encode (Encoder *E, const TValue *o, int depth);
+
+/*
+** Tables are written as their array part (without its trailing nils)
+** and the pairs in their node part
+*/
+static void enctable (Encoder *E, Table *t, int depth) {
+  lua_State *L = E->L;
+  unsigned int i, n = t->sizearray;
+  unsigned int nhash = 0;
+  int nodes = allocsizenode(t);
+  int j;
+  lua_Integer ref;
+  char *p;
+  /* anchor it before anything can run a collection step (the caller
+     left a free slot) */
+  sethvalue(L, L->top, t);
+  api_incr_top(L);
+  ref = lookup(E, t, E->ntab);
+  if (ref != 0) {
+    L->top--;
+    addheader(E, T_TABREF, (lua_Unsigned)ref);
+    return;
+  }
+  E->ntab++;
+  if (depth >= LUAI_SERDEPTH)
+    luaL_error(L, "table too deep to serialize");
+  luaL_checkstack(L, 2, "table too deep to serialize");
+  while (n > 0 && ttisnil(&t->array[n - 1])) n--;
+  for (j = 0; j < nodes; j++) {
+    if (!ttisnil(gval(gnode(t, j)))) nhash++;
+  }
+  addheader(E, T_TABLE, n);
+  p = prepbuff(E, MAXVARINT);
+  addsize(E, putvarint(p, nhash));
+  for (i = 0; i < n; i++)
+    encode(E, &t->array[i], depth + 1);
+  for (j = 0; j < nodes; j++) {
+    Node *nd = gnode(t, j);
+    if (!ttisnil(gval(nd)) && nhash > 0) {
+      encode(E, gkey(nd), depth + 1);
+      encode(E, gval(nd), depth + 1);
+      nhash--;
+    }
+  }
+  /* entries of a weak table may be cleared by a collection step while
+     it is written; fill in for them with pairs that set nothing */
+  for (; nhash > 0; nhash--) {
+    addtag(E, T_FALSE);
+    addtag(E, T_NIL);
+  }
+  L->top--;
+}
+
+
+static void encode (Encoder *E, const TValue *o, int depth) {
+  switch (ttype(o)) {
+    case LUA_TNIL: addtag(E, T_NIL); break;
+    case LUA_TBOOLEAN:
+      addtag(E, bvalue(o) ? T_TRUE : T_FALSE);
+      break;
+    case LUA_TNUMINT: {
+      lua_Integer i = ivalue(o);
+      if (0 <= i && i <= MAXSMALLINT)
+        addtag(E, T_SMALLINT + (int)i);
+      else {  /* zigzag: small negatives are short */
+        lua_Unsigned u = l_castS2U(i) << 1;
+        addheader(E, T_INT, (i < 0) ? ~u : u);
+      }
+      break;
+    }
+    case LUA_TNUMFLT: {
+      lua_Number x = fltvalue(o);
+      char *p = prepbuff(E, 1 + sizeof(x));
+      *p = (char)T_FLOAT;
+      memcpy(p + 1, &x, sizeof(x));
+      addsize(E, 1 + sizeof(x));
+      break;
+    }
+    case LUA_TSHRSTR: case LUA_TLNGSTR: encstring(E, tsvalue(o)); break;
+    case LUA_TTABLE: enctable(E, hvalue(o), depth); break;
+    default:
+      luaL_error(E->L, "cannot serialize a %s value",
+                       lua_typename(E->L, ttnov(o)));
+  }
+}
+
+
+static int ser_encode (lua_State *L) {
+  Encoder E;
+  luaL_checkany(L, 1);
+  lua_settop(L, 1);
+  lua_pushnil(L);  /* slot for the table of values seen */
+  lua_pushnil(L);  /* slot for the box */
+  E.L = L;
+  E.slot = 2;
+  E.box = 3;
+  E.seen = NULL;
+  E.size = E.n = 0;
+  E.nstr = E.ntab = 0;
+  luaL_buffinit(L, &E.b);
+  encode(&E, L->ci->func + 1, 0);
+  lua_settop(L, (E.b.b != E.b.initb) ? E.box : E.box - 1);
+  luaL_pushresult(&E.b);
+  return 1;
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Decoder
+** =======================================================
+*/
+
+/*
+** Strings and tables already read are kept in sequences (at fixed
+** stack slots), to be pushed again by references. These tables also
+** keep them alive: a value can be dropped from the table being built
+** (e.g., by a repeated key) and still be referred to later.
+*/
+
+typedef struct Refs {
+  lua_Integer n;  /* number of values in the sequence */
+  int slot;  /* stack slot of the sequence */
+} Refs;
+
+
+typedef struct Decoder {
+  lua_State *L;
+  const char *p, *end;
+  Refs strs, tabs;
+} Decoder;
+
+
+static void malformed (Decoder *D) {
+  luaL_argerror(D->L, 1, "malformed data");
+}
+
+
+static lua_Unsigned getvarint (Decoder *D) {
+  lua_Unsigned x = 0;
+  int shift = 0;
+  for (;;) {
+    unsigned char c;
+    if (D->p >= D->end || shift >= (int)sizeof(lua_Unsigned) * 8)
+      malformed(D);
+    c = (unsigned char)*D->p++;
+    x |= (lua_Unsigned)(c & 0x7f) << shift;
+    if (c < 0x80) return x;
+    shift += 7;
+  }
+}
+
+
+/* read a count of items, each using at least a byte */
+static size_t getcount (Decoder *D) {
+  lua_Unsigned x = getvarint(D);
+  if (x > (lua_Unsigned)(D->end - D->p))
+    malformed(D);
+  return (size_t)x;
+}
+
+
+/*
+** Read a reference into 'R' and push its value
+*/
+static void getref (Decoder *D, Refs *R) {
+  lua_Unsigned i = getvarint(D);
+  if (i == 0 || i > (lua_Unsigned)R->n)
+    malformed(D);
+  lua_rawgeti(D->L, R->slot, (lua_Integer)i);
+}
+
+
+/*
+** Add the value at the top to 'R'
+*/
+static void addref (Decoder *D, Refs *R) {
+  lua_pushvalue(D->L, -1);
+  lua_rawseti(D->L, R->slot, ++R->n);
+}
+
+
+static void decstring (Decoder *D, size_t l) {
+  if ((size_t)(D->end - D->p) < l)
+    malformed(D);
+  lua_pushlstring(D->L, D->p, l);
+  D->p += l;
+  if (l >= MINREF)
+    addref(D, &D->strs);
+}
+
+
+static void decode (Decoder *D, int depth);
+
+static void dectable (Decoder *D, int depth) {
+  lua_State *L = D->L;
+  size_t narray = getcount(D);
+  size_t nhash = getcount(D);
+  size_t i;
+  if (depth >= LUAI_SERDEPTH || narray > INT_MAX || nhash > INT_MAX)
+    malformed(D);
+  luaL_checkstack(L, 4, "table too deep to deserialize");
+  lua_createtable(L, (int)narray, (int)nhash);
+  addref(D, &D->tabs);
+  for (i = 1; i <= narray; i++) {
+    decode(D, depth + 1);
+    lua_rawseti(L, -2, (lua_Integer)i);
+  }
+  for (i = 0; i < nhash; i++) {
+    decode(D, depth + 1);
+    if (lua_isnil(L, -1)) malformed(D);
+    decode(D, depth + 1);
+    lua_rawset(L, -3);
+  }
+}
+
+
+/*
+** Push the next value
+*/
+static void decode (Decoder *D, int depth) {
+  lua_State *L = D->L;
+  int tag;
+  if (D->p >= D->end) malformed(D);
+  tag = (unsigned char)*D->p++;
+  if (tag >= T_SMALLINT)
+    lua_pushinteger(L, tag - T_SMALLINT);
+  else if (tag >= T_SHORTSTR)
+    decstring(D, (size_t)(tag - T_SHORTSTR));
+  else switch (tag) {
+    case T_NIL: lua_pushnil(L); break;
+    case T_FALSE: lua_pushboolean(L, 0); break;
+    case T_TRUE: lua_pushboolean(L, 1); break;
+    case T_INT: {
+      lua_Unsigned u = getvarint(D);
+      lua_pushinteger(L, (lua_Integer)((u >> 1) ^ (~(u & 1) + 1)));
+      break;
+    }
+    case T_FLOAT: {
+      lua_Number x;
+      if ((size_t)(D->end - D->p) < sizeof(x)) malformed(D);
+      memcpy(&x, D->p, sizeof(x));
+      D->p += sizeof(x);
+      lua_pushnumber(L, x);
+      break;
+    }
+    case T_STRING: decstring(D, getcount(D)); break;
+    case T_STRREF: getref(D, &D->strs); break;
+    case T_TABLE: dectable(D, depth); break;
+    case T_TABREF: getref(D, &D->tabs); break;
+    default: malformed(D);
+  }
+}
+
+
+static lua_Integer posrelat (lua_Integer pos, size_t len) {
+  if (pos >= 0) return pos;
+  else if (0u - (size_t)pos > len) return 0;
+  else return (lua_Integer)len + pos + 1;
+}
+
+
+static int ser_decode (lua_State *L) {
+  Decoder D;
+  size_t ld;
+  const char *data = luaL_checklstring(L, 1, &ld);
+  size_t pos = (size_t)posrelat(luaL_optinteger(L, 2, 1), ld) - 1;
+  luaL_argcheck(L, pos <= ld, 2, "initial position out of string");
+  lua_settop(L, 2);
+  lua_newtable(L);  /* strings already read */
+  lua_newtable(L);  /* tables already read */
+  D.L = L;
+  D.p = data + pos;
+  D.end = data + ld;
+  D.strs.n = D.tabs.n = 0;
+  D.strs.slot = 3;
+  D.tabs.slot = 4;
+  decode(&D, 0);
+  lua_pushinteger(L, (lua_Integer)(D.p - data) + 1);  /* next position */
+  return 2;
+}
+
+/* }====================================================== */
+
+
+static const luaL_Reg ser_funcs[] = {
+  {"encode", ser_encode},
+  {"decode", ser_decode},
+  {NULL, NULL}
+};
+
+
+LUAMOD_API int luaopen_serialize (lua_State *L) {
+  luaL_newlib(L, ser_funcs);
+  return 1;
+}
+
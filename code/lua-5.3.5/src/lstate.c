@@ -48,6 +48,34 @@
 
 
 
+/*
+** initial number of entries in a block of CallInfo structures; each new
+** block doubles the previous one
+*/
+#if !defined(LUAI_CIBLOCK)
+#define LUAI_CIBLOCK	8
+#endif
+
+
+
+/*
+** The 'ci' list after 'base_ci' lives in blocks of consecutive entries,
+** so that nearby call levels are nearby in memory and a deep call
+** chain does not allocate one CallInfo per level. The list is ordered
+** by block: entries after 'L->ci' in older blocks are never freed.
+*/
+typedef struct CIBlock {
+  struct CIBlock *prev;  /* older block */
+  int n;  /* number of entries in 'ci' */
+  CallInfo ci[1];
+} CIBlock;
+
+#define sizeCIBlock(n)	(offsetof(CIBlock, ci) + cast(size_t, n) * sizeof(CallInfo))
+
+#define inblock(b,c)	((b)->ci <= (c) && (c) < (b)->ci + (b)->n)
+
+
+
 /*
 ** thread state + extra space
 */
@@ -110,60 +138,74 @@ void luaE_setdebt (global_State *g, l_mem debt) {
 
 
 CallInfo *luaE_extendCI (lua_State *L) {
-  CallInfo *ci = luaM_new(L, CallInfo);
+  CIBlock *b;
+  int i;
+  int n = (L->ciblock == NULL) ? LUAI_CIBLOCK : 2 * L->ciblock->n;
   lua_assert(L->ci->next == NULL);
-  L->ci->next = ci;
-  ci->previous = L->ci;
-  ci->next = NULL;
-  L->nci++;
-  return ci;
+  b = cast(CIBlock *, luaM_malloc(L, sizeCIBlock(n)));
+  b->prev = L->ciblock;
+  b->n = n;
+  L->ciblock = b;
+  for (i = 0; i < n; i++) {  /* chain new entries after 'L->ci' */
+    b->ci[i].previous = (i == 0) ? L->ci : &b->ci[i - 1];
+    b->ci[i].next = (i + 1 < n) ? &b->ci[i + 1] : NULL;
+  }
+  L->ci->next = b->ci;
+  L->nci += n;
+  return b->ci;
+}
+
+
+/*
+** free newest block of CallInfo structures (not in use by the thread)
+** and end the list at the last entry of the previous one
+*/
+static void freeCIblock (lua_State *L) {
+  CIBlock *b = L->ciblock;
+  lua_assert(!inblock(b, L->ci));
+  L->ciblock = b->prev;
+  L->nci -= b->n;
+  luaM_freemem(L, b, sizeCIBlock(b->n));
+  b = L->ciblock;
+  if (b == NULL)
+    L->base_ci.next = NULL;
+  else
+    b->ci[b->n - 1].next = NULL;
 }
 
 
 /*
-** free all CallInfo structures not in use by a thread
+** free all blocks of CallInfo structures not in use by a thread
 */
 void luaE_freeCI (lua_State *L) {
-  CallInfo *ci = L->ci;
-  CallInfo *next = ci->next;
-  ci->next = NULL;
-  while ((ci = next) != NULL) {
-    next = ci->next;
-    luaM_free(L, ci);
-    L->nci--;
-  }
+  while (L->ciblock != NULL && !inblock(L->ciblock, L->ci))
+    freeCIblock(L);
 }
 
 
 /*
-** free half of the CallInfo structures not in use by a thread
+** free the newest block of CallInfo structures if not in use by a
+** thread (about half of all entries, as blocks grow geometrically)
 */
 void luaE_shrinkCI (lua_State *L) {
-  CallInfo *ci = L->ci;
-  CallInfo *next2;  /* next's next */
-  /* while there are two nexts */
-  while (ci->next != NULL && (next2 = ci->next->next) != NULL) {
-    luaM_free(L, ci->next);  /* free next */
-    L->nci--;
-    ci->next = next2;  /* remove 'next' from the list */
-    next2->previous = ci;
-    ci = next2;  /* keep next's next */
-  }
+  if (L->ciblock != NULL && !inblock(L->ciblock, L->ci))
+    freeCIblock(L);
 }
 
 
-static void stack_init (lua_State *L1, lua_State *L) {
+/*
+** erase the stack and make 'base_ci' the only active call, keeping
+** the list of free CallInfo structures
+*/
+static void stack_reset (lua_State *L1) {
   int i; CallInfo *ci;
-  /* initialize stack array */
-  L1->stack = luaM_newvector(L, BASIC_STACK_SIZE, TValue);
-  L1->stacksize = BASIC_STACK_SIZE;
-  for (i = 0; i < BASIC_STACK_SIZE; i++)
-    setnilvalue(L1->stack + i);  /* erase new stack */
+  for (i = 0; i < L1->stacksize; i++)
+    setnilvalue(L1->stack + i);  /* erase stack */
   L1->top = L1->stack;
   L1->stack_last = L1->stack + L1->stacksize - EXTRA_STACK;
   /* initialize first ci */
   ci = &L1->base_ci;
-  ci->next = ci->previous = NULL;
+  ci->previous = NULL;
   ci->callstatus = 0;
   ci->func = L1->top;
   setnilvalue(L1->top++);  /* 'function' entry for this 'ci' */
@@ -172,13 +214,22 @@ static void stack_init (lua_State *L1, lua_State *L) {
 }
 
 
+static void stack_init (lua_State *L1, lua_State *L) {
+  /* initialize stack array */
+  L1->stack = luaD_newstack(L, BASIC_STACK_SIZE);
+  L1->stacksize = BASIC_STACK_SIZE;
+  L1->base_ci.next = NULL;
+  stack_reset(L1);
+}
+
+
 static void freestack (lua_State *L) {
   if (L->stack == NULL)
     return;  /* stack not completely built yet */
   L->ci = &L->base_ci;  /* free the entire 'ci' list */
   luaE_freeCI(L);
   lua_assert(L->nci == 0);
-  luaM_freearray(L, L->stack, L->stacksize);  /* free stack array */
+  luaD_freestack(L);  /* free stack array */
 }
 
 
@@ -242,11 +293,13 @@ static void f_luaopen (lua_State *L, void *ud) {
 ** any memory (to avoid errors)
 */
 static void preinit_thread (lua_State *L, global_State *g) {
+  int i;
   G(L) = g;       // 最主要的操作：global_State 赋给这个线程（协程），G(L)->mainthread 就能找到主线程
 
   L->stack = NULL;
   L->ci = NULL;
   L->nci = 0;
+  L->ciblock = NULL;
   L->stacksize = 0;
   // 一开始初始化是 isintwups(L) 的
   L->twups = L;         /* thread has no upvalues */
@@ -258,6 +311,8 @@ static void preinit_thread (lua_State *L, global_State *g) {
   L->allowhook = 1;
   resethookcount(L);
   L->openupval = NULL;
+  for (i = 0; i < LUAI_UVINDEX; i++)
+    L->uvindex[i] = NULL;
   L->nny = 1;
   L->status = LUA_OK;
   L->errfunc = 0;
@@ -268,6 +323,8 @@ static void close_state (lua_State *L) {
   global_State *g = G(L);
   luaF_close(L, L->stack);  /* close all upvalues for this thread */
   luaC_freeallobjects(L);  /* collect all objects */
+  luaE_flushthreads(L);
+  luaM_setprofile(L, 0);
   if (g->version)  /* closing a fully built state? */
     luai_userstateclose(L);
   luaM_freearray(L, G(L)->strt.hash, G(L)->strt.size);
@@ -285,15 +342,30 @@ static void close_state (lua_State *L) {
 LUA_API lua_State *lua_newthread (lua_State *L) {
   global_State *g = G(L);   // 主线程拿到的 global_State
   lua_State *L1;
+  TValue *stack = NULL;
+  int stacksize = 0;
+  unsigned short nci = 0;
+  CIBlock *ciblock = NULL;
   lua_lock(L);
   luaC_checkGC(L);
   
-  /**
-   * 与 lua_newstate 不同
-   * 这里申请的是 LX 空间 而非 LG
-   * 
-   * create new thread */
-  L1 = &cast(LX *, luaM_newobject(L, LUA_TTHREAD, sizeof(LX)))->l;
+  if (g->threadpool != NULL) {  /* reuse a dead thread? */
+    L1 = g->threadpool;
+    g->threadpool = L1->twups;
+    g->npooled--;
+    stack = L1->stack;  /* keep its stack and CallInfo list */
+    stacksize = L1->stacksize;
+    nci = L1->nci;
+    ciblock = L1->ciblock;
+  }
+  else {
+    /**
+     * 与 lua_newstate 不同
+     * 这里申请的是 LX 空间 而非 LG
+     * 
+     * create new thread */
+    L1 = &cast(LX *, luaM_newobject(L, LUA_TTHREAD, sizeof(LX)))->l;
+  }
 
   // 类似 luaC_newobj 的操作
   L1->marked = luaC_white(g);
@@ -317,21 +389,57 @@ LUA_API lua_State *lua_newthread (lua_State *L) {
          LUA_EXTRASPACE);
 
   luai_userstatethread(L, L1);
-  stack_init(L1, L);  /* init stack */
+  if (stack != NULL) {  /* reused thread? */
+    L1->stack = stack;
+    L1->stacksize = stacksize;
+    L1->nci = nci;
+    L1->ciblock = ciblock;
+    stack_reset(L1);
+  }
+  else
+    stack_init(L1, L);  /* init stack */
   lua_unlock(L);
   return L1;
 }
 
 
+/*
+** A dead thread with a moderate stack goes to 'g->threadpool' (linked
+** through 'twups') instead of being freed, so that 'lua_newthread' can
+** reuse its block, stack, and CallInfo list.
+*/
 void luaE_freethread (lua_State *L, lua_State *L1) {
+  global_State *g = G(L);
   LX *l = fromstate(L1);
   luaF_close(L1, L1->stack);  /* close all upvalues for this thread */
   lua_assert(L1->openupval == NULL);
   luai_userstatefree(L, L1);
+  if (L1->stack != NULL && g->npooled < LUAI_MAXPOOLTHREADS &&
+      L1->stacksize <= LUAI_MAXPOOLSTACK) {
+    L1->twups = g->threadpool;
+    g->threadpool = L1;
+    g->npooled++;
+    return;
+  }
   freestack(L1);
   luaM_free(L, l);
 }
 
+
+/*
+** free all threads kept for reuse
+*/
+void luaE_flushthreads (lua_State *L) {
+  global_State *g = G(L);
+  while (g->threadpool != NULL) {
+    lua_State *L1 = g->threadpool;
+    g->threadpool = L1->twups;
+    freestack(L1);
+    luaM_free(L, fromstate(L1));
+  }
+  g->npooled = 0;
+}
+
 /**
  * 创建主线程
 */
@@ -356,6 +464,7 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->frealloc = f;        // 内存申请函数              |-----两者互相建立关系
   g->ud = ud;             // 内存申请函数附加参数       |
   g->mainthread = L;      // g->mainthread = L;-------|
+  g->running = L;
 
   g->seed = makeseed(L);  // 用于 luaS_hash 的种子
 
@@ -375,11 +484,17 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->gray = g->grayagain = NULL;
   g->weak = g->ephemeron = g->allweak = NULL;
   g->twups = NULL;
+  g->threadpool = NULL;
+  g->npooled = 0;
+  g->allocprof = NULL;
   g->totalbytes = sizeof(LG);
   g->GCdebt = 0;
   g->gcfinnum = 0;
   g->gcpause = LUAI_GCPAUSE;
   g->gcstepmul = LUAI_GCMUL;
+#if defined(LUAI_VMSTATS)
+  memset(&g->vmstats, 0, sizeof(g->vmstats));
+#endif
 
   for (i=0; i < LUA_NUMTAGS; i++) g->mt[i] = NULL;
   if (luaD_rawrunprotected(L, f_luaopen, NULL) != LUA_OK) {
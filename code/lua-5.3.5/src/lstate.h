@@ -197,6 +197,34 @@ typedef struct CallInfo {
  * int gcstepmul;
  * 
 */
+#if defined(LUAI_VMSTATS)
+
+#include "lopcodes.h"
+
+/*
+** counters of VM activity (see 'lua_vmstats')
+*/
+typedef struct VMStats {
+  lu_mem op[NUM_OPCODES];  /* instructions executed, by opcode */
+  lu_mem finishget;        /* reads that fell back to 'luaV_finishget' */
+  lu_mem finishset;        /* writes that fell back to 'luaV_finishset' */
+  lu_mem calllua;          /* calls to Lua functions */
+  lu_mem callc;            /* calls to C closures */
+  lu_mem calllcf;          /* calls to light C functions */
+  lu_mem callleaf;         /* leaf calls made by the VM fast path */
+  lu_mem concat;           /* strings created by concatenation */
+  lu_mem concatbytes;      /* total length of those strings */
+} VMStats;
+
+#define luai_vmstat(L,f,n)	(G(L)->vmstats.f += (n))
+
+#else
+
+#define luai_vmstat(L,f,n)	((void)0)
+
+#endif
+
+
 typedef struct global_State {
   lua_Alloc frealloc;     /* function to reallocate memory */
   void *ud;               /* auxiliary data to 'frealloc' */
@@ -230,6 +258,9 @@ typedef struct global_State {
   GCObject *fixedgc;      /* list of objects not to be collected */
 
   struct lua_State *twups;      /* list of threads with open upvalues */
+  struct lua_State *threadpool; /* dead threads kept for reuse */
+  int npooled;                  /* number of threads in 'threadpool' */
+  struct AllocProf *allocprof;  /* allocation profiler (NULL when off) */
 
   unsigned int gcfinnum;        /* number of finalizers to call in each GC step */
   int gcpause;                  /* size of pause between successive GCs */
@@ -237,6 +268,7 @@ typedef struct global_State {
 
   lua_CFunction panic;          /* to be called in unprotected errors */
   struct lua_State *mainthread;
+  struct lua_State *running;    /* innermost thread being resumed (or main) */
   
   const lua_Number *version;                  /* pointer to version number */
 
@@ -246,6 +278,9 @@ typedef struct global_State {
   struct Table *mt[LUA_NUMTAGS];              /* metatables for basic types */
 
   TString *strcache[STRCACHE_N][STRCACHE_M];  /* cache for strings in API */
+#if defined(LUAI_VMSTATS)
+  VMStats vmstats;
+#endif
 
 } global_State;
 
@@ -302,6 +337,7 @@ struct lua_State {
   StkId stack;                      /* stack base */
 
   UpVal *openupval;                 /* list of open upvalues in this stack */
+  UpVal *uvindex[LUAI_UVINDEX];     /* open upvalues hashed by stack slot */
 
   GCObject *gclist;
 
@@ -309,6 +345,7 @@ struct lua_State {
   struct lua_longjmp *errorJmp;     /* current error recover point */
 
   CallInfo base_ci;                 /* CallInfo for first level (C calling Lua) */
+  struct CIBlock *ciblock;          /* blocks holding the 'ci' list (newest first) */
   volatile lua_Hook hook;
 
   ptrdiff_t errfunc;                /* current error handling function (stack index) */
@@ -369,6 +406,7 @@ union GCUnion {
 
 LUAI_FUNC void luaE_setdebt (global_State *g, l_mem debt);
 LUAI_FUNC void luaE_freethread (lua_State *L, lua_State *L1);
+LUAI_FUNC void luaE_flushthreads (lua_State *L);
 LUAI_FUNC CallInfo *luaE_extendCI (lua_State *L);
 LUAI_FUNC void luaE_freeCI (lua_State *L);
 LUAI_FUNC void luaE_shrinkCI (lua_State *L);
@@ -24,6 +24,8 @@
 #include "lauxlib.h"
 #include "lualib.h"
 
+#include "lstrlib.h"
+
 
 /*
 ** maximum number of captures that a pattern can do during
@@ -604,9 +606,13 @@ static void reprepstate (MatchState *ms) {
 }
 
 
-static int str_find_aux (lua_State *L, int find) {
-  size_t ls, lp;
-  const char *s = luaL_checklstring(L, 1, &ls);
+/*
+** 'find'/'match' on the 'ls' bytes at 's', with the pattern and the
+** optional 'init' and 'plain' at indices 2 to 4. (Also used by the
+** mapped files of the io library, whose contents are not a string.)
+*/
+int luaI_strfind (lua_State *L, const char *s, size_t ls, int find) {
+  size_t lp;
   const char *p = luaL_checklstring(L, 2, &lp);
   lua_Integer init = posrelat(luaL_optinteger(L, 3, 1), ls);
   if (init < 1) init = 1;
@@ -651,6 +657,13 @@ static int str_find_aux (lua_State *L, int find) {
 }
 
 
+static int str_find_aux (lua_State *L, int find) {
+  size_t ls;
+  const char *s = luaL_checklstring(L, 1, &ls);
+  return luaI_strfind(L, s, ls, find);
+}
+
+
 static int str_find (lua_State *L) {
   return str_find_aux(L, 1);
 }
@@ -0,0 +1,23 @@
+/*
+** Pattern matching shared by the standard libraries
+** See Copyright Notice in lua.h
+*/
+
+#ifndef lstrlib_h
+#define lstrlib_h
+
+
+#include "lua.h"
+
+
+/*
+** 'find'/'match' on a block of memory that need not be a Lua string
+** (used by 'string.find'/'string.match' and by the mapped files of
+** the io library)
+*/
+LUAI_FUNC int luaI_strfind (lua_State *L, const char *s, size_t ls,
+                                           int find);
+
+
+#endif
+
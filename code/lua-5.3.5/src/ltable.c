@@ -129,7 +129,7 @@ static Node *mainposition (const Table *t, const TValue *key) {
       return hashboolean(t, bvalue(key));
     case LUA_TLIGHTUSERDATA:
       return hashpointer(t, pvalue(key));
-    case LUA_TLCF:
+    case LUA_TLCF: case LUA_TLCFL:
       return hashpointer(t, fvalue(key));
     default:
       lua_assert(!ttisdeadkey(key));
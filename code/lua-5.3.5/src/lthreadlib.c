@@ -0,0 +1,1010 @@
+/*
+** Worker threads library
+** See Copyright Notice in lua.h
+*/
+
+#define lthreadlib_c
+#define LUA_LIB
+
+#include "lprefix.h"
+
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+/*
+** A pool is a set of OS threads, each running its own independent
+** Lua state. States share nothing: a job is a message with the source
+** of a chunk (which must return the job function) and the arguments,
+** and its reply is a message with the results. Values are copied in a
+** compact binary form (nil, booleans, numbers, strings and tables of
+** those), written and read directly from the stacks. Each worker has
+** an inbox and the pool has an outbox for the replies; both are
+** multiple-producer/single-consumer queues where producers never take
+** a lock (an atomic exchange links a message), and a consumer only
+** sleeps on a condition variable when its queue is empty.
+*/
+
+#if defined(LUA_USE_POSIX) && defined(__GNUC__)	/* { */
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+
+/* maximum nesting of tables in a message */
+#if !defined(LUAI_MSGDEPTH)
+#define LUAI_MSGDEPTH		200
+#endif
+
+/* jobs per worker that 'map' splits its array into, by default */
+#if !defined(LUAI_MAPSPLIT)
+#define LUAI_MAPSPLIT		4
+#endif
+
+
+#define l_xchg(p,v)	__atomic_exchange_n(p, v, __ATOMIC_SEQ_CST)
+#define l_load(p)	__atomic_load_n(p, __ATOMIC_SEQ_CST)
+#define l_store(p,v)	__atomic_store_n(p, v, __ATOMIC_SEQ_CST)
+#define l_add(p,v)	__atomic_add_fetch(p, v, __ATOMIC_SEQ_CST)
+
+
+#define POOL		"threads.pool"
+#define MBUFFER		"threads.buffer"
+
+/* key, in the registry of a worker, of its cache of job functions */
+static const char *const JOBS = "_THREADJOBS";
+
+
+/*
+** {======================================================
+** Messages
+** =======================================================
+*/
+
+/* kinds of messages */
+enum { M_RUN, M_MAP, M_STOP };
+
+/* tags of encoded values */
+enum { T_NIL, T_FALSE, T_TRUE, T_INT, T_FLOAT, T_STRING, T_TABLE };
+
+/* maximum size of a variable-length integer */
+#define MAXVARINT	((sizeof(lua_Unsigned) * 8 + 6) / 7)
+
+
+typedef struct Msg {
+  struct Msg *next;
+  int kind;
+  lua_Integer id;
+  char *data;  /* encoded values (malloc'ed) */
+  size_t len;
+} Msg;
+
+
+/*
+** Growing buffer in a userdata, so that its memory is released if an
+** error interrupts the encoding (or decoding, for an input buffer)
+*/
+typedef struct MBuffer {
+  char *p;
+  size_t n, size;
+} MBuffer;
+
+
+static int mbuff_gc (lua_State *L) {
+  MBuffer *B = (MBuffer *)lua_touserdata(L, 1);
+  free(B->p);
+  B->p = NULL;
+  return 0;
+}
+
+
+static MBuffer *newmbuff (lua_State *L) {
+  MBuffer *B = (MBuffer *)lua_newuserdata(L, sizeof(MBuffer));
+  B->p = NULL;
+  B->n = B->size = 0;
+  luaL_setmetatable(L, MBUFFER);
+  return B;
+}
+
+
+static char *prepmbuff (lua_State *L, MBuffer *B, size_t sz) {
+  if (B->size - B->n < sz) {
+    size_t newsize = (B->size < 64) ? 64 : B->size * 2;
+    char *p;
+    if (newsize - B->n < sz) newsize = B->n + sz;
+    p = (char *)realloc(B->p, newsize);
+    if (p == NULL)
+      luaL_error(L, "not enough memory");
+    B->p = p;
+    B->size = newsize;
+  }
+  return B->p + B->n;
+}
+
+
+static void addmbuff (lua_State *L, MBuffer *B, const void *s, size_t l) {
+  memcpy(prepmbuff(L, B, l), s, l);
+  B->n += l;
+}
+
+
+static size_t putvarint (char *p, lua_Unsigned x) {
+  size_t n = 0;
+  while (x >= 0x80) {
+    p[n++] = (char)((x & 0x7f) | 0x80);
+    x >>= 7;
+  }
+  p[n++] = (char)x;
+  return n;
+}
+
+
+static void addheader (lua_State *L, MBuffer *B, int tag, lua_Unsigned x) {
+  char *p = prepmbuff(L, B, 1 + MAXVARINT);
+  p[0] = (char)tag;
+  B->n += 1 + putvarint(p + 1, x);
+}
+
+
+#define addtag(L,B,t)	(*prepmbuff(L, B, 1) = (char)(t), (B)->n++)
+
+
+/* is the key at 'k' an index of the array part [1, n] ? */
+static int inarray (lua_State *L, int k, lua_Integer n) {
+  lua_Integer i;
+  if (!lua_isinteger(L, k)) return 0;
+  i = lua_tointeger(L, k);
+  return (1 <= i && i <= n);
+}
+
+
+/*
+** Append the value at index 'idx' (absolute) to buffer. Tables are
+** written as their array part [1, #t] followed by their other pairs,
+** each part preceded by its size, so that they can be presized when
+** read. Metatables are ignored.
+*/
+static void encode (lua_State *L, MBuffer *B, int idx, int depth) {
+  switch (lua_type(L, idx)) {
+    case LUA_TNIL: addtag(L, B, T_NIL); break;
+    case LUA_TBOOLEAN:
+      addtag(L, B, lua_toboolean(L, idx) ? T_TRUE : T_FALSE);
+      break;
+    case LUA_TNUMBER: {
+      if (lua_isinteger(L, idx)) {  /* zigzag: small negatives are short */
+        lua_Integer i = lua_tointeger(L, idx);
+        lua_Unsigned u = (lua_Unsigned)i << 1;
+        addheader(L, B, T_INT, (i < 0) ? ~u : u);
+      }
+      else {
+        lua_Number n = lua_tonumber(L, idx);
+        addtag(L, B, T_FLOAT);
+        addmbuff(L, B, &n, sizeof(n));
+      }
+      break;
+    }
+    case LUA_TSTRING: {
+      size_t l;
+      const char *s = lua_tolstring(L, idx, &l);
+      addheader(L, B, T_STRING, l);
+      addmbuff(L, B, s, l);
+      break;
+    }
+    case LUA_TTABLE: {
+      lua_Integer n = (lua_Integer)lua_rawlen(L, idx);
+      lua_Integer i;
+      size_t nhash = 0;
+      char *p;
+      if (depth >= LUAI_MSGDEPTH)
+        luaL_error(L, "table too deep (or cyclic) to be sent");
+      luaL_checkstack(L, 3, "table too deep to be sent");
+      lua_pushnil(L);
+      while (lua_next(L, idx)) {  /* count pairs out of the array part */
+        lua_pop(L, 1);
+        if (!inarray(L, -1, n)) nhash++;
+      }
+      addheader(L, B, T_TABLE, (lua_Unsigned)n);
+      p = prepmbuff(L, B, MAXVARINT);
+      B->n += putvarint(p, nhash);
+      for (i = 1; i <= n; i++) {
+        lua_rawgeti(L, idx, i);
+        encode(L, B, lua_gettop(L), depth + 1);
+        lua_pop(L, 1);
+      }
+      lua_pushnil(L);
+      while (lua_next(L, idx)) {
+        if (!inarray(L, -2, n)) {
+          int top = lua_gettop(L);
+          encode(L, B, top - 1, depth + 1);
+          encode(L, B, top, depth + 1);
+        }
+        lua_pop(L, 1);
+      }
+      break;
+    }
+    default:
+      luaL_error(L, "cannot send a %s value", luaL_typename(L, idx));
+  }
+}
+
+
+typedef struct Reader {
+  const char *p, *end;
+} Reader;
+
+
+static void corrupted (lua_State *L) {
+  luaL_error(L, "corrupted message");
+}
+
+
+static lua_Unsigned getvarint (lua_State *L, Reader *R) {
+  lua_Unsigned x = 0;
+  int shift = 0;
+  for (;;) {
+    unsigned char c;
+    if (R->p >= R->end || shift >= (int)sizeof(lua_Unsigned) * 8)
+      corrupted(L);
+    c = (unsigned char)*R->p++;
+    x |= (lua_Unsigned)(c & 0x7f) << shift;
+    if (c < 0x80) return x;
+    shift += 7;
+  }
+}
+
+
+static size_t getsize (lua_State *L, Reader *R) {
+  lua_Unsigned x = getvarint(L, R);
+  if (x > (lua_Unsigned)(R->end - R->p))  /* each item uses at least a byte */
+    corrupted(L);
+  return (size_t)x;
+}
+
+
+/*
+** Push the next value of a message
+*/
+static void decode (lua_State *L, Reader *R, int depth) {
+  if (R->p >= R->end) corrupted(L);
+  switch (*R->p++) {
+    case T_NIL: lua_pushnil(L); break;
+    case T_FALSE: lua_pushboolean(L, 0); break;
+    case T_TRUE: lua_pushboolean(L, 1); break;
+    case T_INT: {
+      lua_Unsigned u = getvarint(L, R);
+      lua_pushinteger(L, (lua_Integer)((u >> 1) ^ (~(u & 1) + 1)));
+      break;
+    }
+    case T_FLOAT: {
+      lua_Number n;
+      if ((size_t)(R->end - R->p) < sizeof(n)) corrupted(L);
+      memcpy(&n, R->p, sizeof(n));
+      R->p += sizeof(n);
+      lua_pushnumber(L, n);
+      break;
+    }
+    case T_STRING: {
+      size_t l = getsize(L, R);
+      lua_pushlstring(L, R->p, l);
+      R->p += l;
+      break;
+    }
+    case T_TABLE: {
+      size_t narray = getsize(L, R);
+      size_t nhash = getsize(L, R);
+      size_t i;
+      if (depth >= LUAI_MSGDEPTH || narray > INT_MAX || nhash > INT_MAX)
+        corrupted(L);
+      luaL_checkstack(L, 3, "message too deep");
+      lua_createtable(L, (int)narray, (int)nhash);
+      for (i = 1; i <= narray; i++) {
+        decode(L, R, depth + 1);
+        lua_rawseti(L, -2, (lua_Integer)i);
+      }
+      for (i = 0; i < nhash; i++) {
+        decode(L, R, depth + 1);
+        decode(L, R, depth + 1);
+        if (lua_isnil(L, -2)) corrupted(L);
+        lua_rawset(L, -3);
+      }
+      break;
+    }
+    default: corrupted(L);
+  }
+}
+
+
+/*
+** Move the contents of buffer 'B' to a new message
+*/
+static Msg *newmsg (lua_State *L, MBuffer *B, int kind, lua_Integer id) {
+  Msg *m = (Msg *)malloc(sizeof(Msg));
+  char *data = (char *)malloc(B->n + 1);
+  if (m == NULL || data == NULL) {
+    free(m); free(data);
+    luaL_error(L, "not enough memory");
+  }
+  memcpy(data, B->p, B->n);
+  m->next = NULL;
+  m->kind = kind;
+  m->id = id;
+  m->data = data;
+  m->len = B->n;
+  return m;
+}
+
+
+static void freemsg (Msg *m) {
+  free(m->data);
+  free(m);
+}
+
+
+/*
+** Move the data of message 'm' to buffer 'B' (releasing what it had),
+** where it will be read; frees the message
+*/
+static void takemsg (MBuffer *B, Msg *m, Reader *R) {
+  free(B->p);
+  B->p = m->data;
+  B->n = B->size = m->len;
+  R->p = B->p;
+  R->end = B->p + B->n;
+  free(m);
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Queues
+** =======================================================
+*/
+
+/*
+** An intrusive MPSC queue (as described by D. Vyukov). 'head' is the
+** last message pushed; producers swap themselves in and then link the
+** previous head to them. The consumer reads from 'tail'; 'stub' keeps
+** the list from becoming empty. 'count' has the number of messages
+** completely pushed, and 'sleeping' tells producers to wake up the
+** consumer.
+*/
+typedef struct Queue {
+  Msg *head;
+  Msg *tail;
+  Msg stub;
+  int count;
+  int sleeping;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+} Queue;
+
+
+static void q_init (Queue *q) {
+  q->stub.next = NULL;
+  q->head = q->tail = &q->stub;
+  q->count = q->sleeping = 0;
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->wake, NULL);
+}
+
+
+static void q_link (Queue *q, Msg *m) {
+  Msg *prev;
+  m->next = NULL;
+  prev = l_xchg(&q->head, m);
+  l_store(&prev->next, m);
+}
+
+
+/*
+** Push a message (from any thread)
+*/
+static void q_put (Queue *q, Msg *m) {
+  q_link(q, m);
+  l_add(&q->count, 1);
+  if (l_load(&q->sleeping)) {
+    pthread_mutex_lock(&q->lock);
+    pthread_cond_signal(&q->wake);
+    pthread_mutex_unlock(&q->lock);
+  }
+}
+
+
+/*
+** Remove the oldest message (only from the consumer); returns NULL if
+** there is none, or if the producer of the oldest one has not linked
+** it yet
+*/
+static Msg *q_pop (Queue *q) {
+  Msg *tail = q->tail;
+  Msg *next = l_load(&tail->next);
+  if (tail == &q->stub) {
+    if (next == NULL) return NULL;
+    q->tail = tail = next;
+    next = l_load(&tail->next);
+  }
+  if (next == NULL) {  /* 'tail' is the last message? */
+    if (tail != l_load(&q->head))
+      return NULL;  /* a push is halfway */
+    q_link(q, &q->stub);  /* keep the list non empty */
+    next = l_load(&tail->next);
+    if (next == NULL) return NULL;
+  }
+  q->tail = next;
+  return tail;
+}
+
+
+/*
+** Remove the oldest message, waiting for one if the queue is empty
+*/
+static Msg *q_take (Queue *q) {
+  for (;;) {
+    while (l_load(&q->count) > 0) {
+      Msg *m = q_pop(q);
+      if (m != NULL) {
+        l_add(&q->count, -1);
+        return m;
+      }
+      sched_yield();  /* let the pushing thread finish */
+    }
+    pthread_mutex_lock(&q->lock);
+    l_store(&q->sleeping, 1);
+    while (l_load(&q->count) == 0)
+      pthread_cond_wait(&q->wake, &q->lock);
+    l_store(&q->sleeping, 0);
+    pthread_mutex_unlock(&q->lock);
+  }
+}
+
+
+/*
+** Free the messages left in a queue nobody else uses anymore
+*/
+static void q_destroy (Queue *q) {
+  Msg *m;
+  while ((m = q_pop(q)) != NULL) {
+    if (m->kind != M_STOP) freemsg(m);
+  }
+  pthread_cond_destroy(&q->wake);
+  pthread_mutex_destroy(&q->lock);
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Workers
+** =======================================================
+*/
+
+struct Pool;
+
+typedef struct Worker {
+  pthread_t thread;
+  lua_State *L;
+  struct Pool *P;
+  int started;
+  Queue inbox;
+  Msg stop;  /* message that stops the worker */
+} Worker;
+
+
+typedef struct Pool {
+  int n;  /* number of workers (with a state) */
+  int closed;
+  int next;  /* worker for the next job */
+  lua_Integer lastid;  /* id of the last job */
+  lua_Integer pending;  /* number of jobs whose replies were not taken */
+  Msg *stash, **stashtail;  /* replies received by 'map' for others */
+  Msg *batch;  /* jobs of a 'map' being built */
+  Queue replies;
+  Worker w[1];  /* actual size is 'n' */
+} Pool;
+
+
+#define poolsize(n)	(offsetof(Pool, w) + (n) * sizeof(Worker))
+
+
+/*
+** Push the job function for the source at the start of a job,
+** loading it (by calling the chunk) the first time it is seen
+*/
+static void getjob (lua_State *L, Reader *R) {
+  decode(L, R, 0);
+  if (lua_type(L, -1) != LUA_TSTRING) corrupted(L);
+  if (lua_getfield(L, LUA_REGISTRYINDEX, JOBS) != LUA_TTABLE) {
+    lua_pop(L, 1);
+    lua_newtable(L);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, LUA_REGISTRYINDEX, JOBS);
+  }
+  lua_pushvalue(L, -2);
+  if (lua_rawget(L, -2) != LUA_TFUNCTION) {
+    size_t l;
+    const char *s = lua_tolstring(L, -3, &l);
+    lua_pop(L, 1);
+    if (luaL_loadbuffer(L, s, l, s) != LUA_OK)
+      lua_error(L);
+    lua_call(L, 0, 1);
+    if (lua_type(L, -1) != LUA_TFUNCTION)
+      luaL_error(L, "job source must return a function");
+    lua_pushvalue(L, -3);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, -4);
+  }
+  lua_replace(L, -3);
+  lua_pop(L, 1);
+}
+
+
+/*
+** Run the job in message 1 and replace its data by the results:
+** 'true' followed by the values returned by the job function ('M_RUN')
+** or by its results for each value sent ('M_MAP')
+*/
+static int dojob (lua_State *L) {
+  Msg *m = (Msg *)lua_touserdata(L, 1);
+  MBuffer *in = newmbuff(L);
+  MBuffer *out = newmbuff(L);
+  Reader R;
+  int func;
+  in->p = m->data;  /* 'in' owns the data now */
+  in->n = in->size = m->len;
+  m->data = NULL;
+  R.p = in->p; R.end = in->p + in->n;
+  getjob(L, &R);
+  func = lua_gettop(L);
+  addtag(L, out, T_TRUE);
+  if (m->kind == M_RUN) {
+    int i, top;
+    while (R.p < R.end) {
+      luaL_checkstack(L, 1, "too many arguments");
+      decode(L, &R, 0);
+    }
+    lua_call(L, lua_gettop(L) - func, LUA_MULTRET);
+    top = lua_gettop(L);
+    for (i = func; i <= top; i++)
+      encode(L, out, i, 0);
+  }
+  else {
+    lua_Integer i, n;
+    decode(L, &R, 0);
+    n = lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    for (i = 0; i < n; i++) {
+      lua_pushvalue(L, func);
+      decode(L, &R, 0);
+      lua_call(L, 1, 1);
+      encode(L, out, func + 1, 0);
+      lua_pop(L, 1);
+    }
+  }
+  free(in->p);
+  in->p = NULL;
+  m->data = out->p;  /* message owns the results now */
+  m->len = out->n;
+  out->p = NULL;
+  return 0;
+}
+
+
+/*
+** Replace the data of message 'm' by 'false' and the error message at
+** the top of the stack; without memory, the reply is left empty
+*/
+static void failjob (lua_State *L, Msg *m) {
+  size_t l;
+  const char *msg = lua_tolstring(L, -1, &l);
+  char *p;
+  if (msg == NULL) {
+    msg = "(error object is not a string)";
+    l = strlen(msg);
+  }
+  free(m->data);
+  m->data = p = (char *)malloc(2 + MAXVARINT + l);
+  m->len = 0;
+  if (p != NULL) {
+    p[0] = (char)T_FALSE;
+    p[1] = (char)T_STRING;
+    m->len = 2 + putvarint(p + 2, l);
+    memcpy(p + m->len, msg, l);
+    m->len += l;
+  }
+}
+
+
+static void *workermain (void *ud) {
+  Worker *w = (Worker *)ud;
+  lua_State *L = w->L;
+  for (;;) {
+    Msg *m = q_take(&w->inbox);
+    if (m->kind == M_STOP) break;
+    lua_pushcfunction(L, dojob);
+    lua_pushlightuserdata(L, m);
+    if (lua_pcall(L, 1, 0, 0) != LUA_OK)
+      failjob(L, m);
+    lua_settop(L, 0);
+    q_put(&w->P->replies, m);
+  }
+  return NULL;
+}
+
+
+/*
+** Set up the state of a new worker: its libraries and its (optional)
+** initialization code, at index 1
+*/
+static int initworker (lua_State *L) {
+  luaL_openlibs(L);
+  if (lua_type(L, 1) == LUA_TSTRING) {
+    size_t l;
+    const char *s = lua_tolstring(L, 1, &l);
+    if (luaL_loadbuffer(L, s, l, s) != LUA_OK)
+      lua_error(L);
+    lua_call(L, 0, 0);
+  }
+  return 0;
+}
+
+
+static void startworker (lua_State *L, Worker *w) {
+  if (w->L == NULL)
+    luaL_error(L, "not enough memory");
+  lua_pushcfunction(w->L, initworker);
+  if (lua_isstring(L, 2)) {
+    size_t l;
+    const char *init = lua_tolstring(L, 2, &l);
+    lua_pushlstring(w->L, init, l);
+  }
+  else
+    lua_pushnil(w->L);
+  if (lua_pcall(w->L, 1, 0, 0) != LUA_OK) {
+    const char *msg = lua_tostring(w->L, -1);
+    lua_pushstring(L, msg ? msg : "error initializing worker");
+    lua_error(L);
+  }
+  if (pthread_create(&w->thread, NULL, workermain, w) != 0)
+    luaL_error(L, "cannot create worker thread");
+  w->started = 1;
+}
+
+
+/*
+** Stop all workers (after the jobs they already have) and free
+** everything
+*/
+static void closepool (Pool *P) {
+  int i;
+  Msg *m;
+  for (i = 0; i < P->n; i++) {
+    Worker *w = &P->w[i];
+    if (w->started) {
+      w->stop.kind = M_STOP;
+      q_put(&w->inbox, &w->stop);
+    }
+  }
+  for (i = 0; i < P->n; i++) {
+    Worker *w = &P->w[i];
+    if (w->started)
+      pthread_join(w->thread, NULL);
+    if (w->L != NULL)
+      lua_close(w->L);
+    q_destroy(&w->inbox);
+  }
+  q_destroy(&P->replies);
+  while ((m = P->stash) != NULL) {
+    P->stash = m->next;
+    freemsg(m);
+  }
+  while ((m = P->batch) != NULL) {
+    P->batch = m->next;
+    freemsg(m);
+  }
+  P->n = 0;
+  P->closed = 1;
+}
+
+/* }====================================================== */
+
+
+static Pool *topool (lua_State *L) {
+  Pool *P = (Pool *)luaL_checkudata(L, 1, POOL);
+  if (P->closed)
+    luaL_error(L, "attempt to use a closed pool");
+  return P;
+}
+
+
+static int threads_pool (lua_State *L) {
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  lua_Integer n = luaL_optinteger(L, 1, (ncpu > 0) ? ncpu : 1);
+  Pool *P;
+  int i;
+  luaL_argcheck(L, 0 < n && n <= 1024, 1, "invalid number of workers");
+  if (!lua_isnoneornil(L, 2))
+    luaL_checkstring(L, 2);
+  P = (Pool *)lua_newuserdata(L, poolsize(n));
+  P->n = 0;
+  P->closed = 1;  /* until it has its queue */
+  luaL_setmetatable(L, POOL);
+  P->next = 0;
+  P->lastid = P->pending = 0;
+  P->stash = P->batch = NULL;
+  P->stashtail = &P->stash;
+  q_init(&P->replies);
+  P->closed = 0;
+  for (i = 0; i < n; i++) {
+    Worker *w = &P->w[i];
+    w->P = P;
+    w->started = 0;
+    q_init(&w->inbox);
+    w->L = luaL_newstate();
+    P->n = i + 1;  /* from now on, 'closepool' releases it */
+    startworker(L, w);
+  }
+  return 1;
+}
+
+
+static void dispatch (Pool *P, Msg *m) {
+  q_put(&P->w[P->next].inbox, m);
+  P->next = (P->next + 1) % P->n;
+  P->pending++;
+}
+
+
+/*
+** pool:run(source, ...): starts a job, returning its id
+*/
+static int pool_run (lua_State *L) {
+  Pool *P = topool(L);
+  int i, top = lua_gettop(L);
+  MBuffer *B;
+  luaL_checkstring(L, 2);
+  B = newmbuff(L);
+  for (i = 2; i <= top; i++)
+    encode(L, B, i, 0);
+  dispatch(P, newmsg(L, B, M_RUN, P->lastid + 1));
+  lua_pushinteger(L, ++P->lastid);
+  return 1;
+}
+
+
+/*
+** pool:wait(): waits for a job to finish and returns its id, followed
+** by 'true' and its results or by 'false' and the error message.
+** Returns nothing when there are no jobs running.
+*/
+static int pool_wait (lua_State *L) {
+  Pool *P = topool(L);
+  MBuffer *B;
+  Msg *m;
+  Reader R;
+  int n = 1;
+  if (P->pending == 0)
+    return 0;
+  B = newmbuff(L);
+  if ((m = P->stash) != NULL) {
+    P->stash = m->next;
+    if (P->stash == NULL) P->stashtail = &P->stash;
+  }
+  else
+    m = q_take(&P->replies);
+  P->pending--;
+  lua_pushinteger(L, m->id);
+  takemsg(B, m, &R);
+  if (R.p == R.end) {  /* worker ran out of memory? */
+    lua_pushboolean(L, 0);
+    lua_pushliteral(L, "not enough memory");
+    return 3;
+  }
+  for (; R.p < R.end; n++) {
+    luaL_checkstack(L, 1, "too many results");
+    decode(L, &R, 0);
+  }
+  return n;
+}
+
+
+/*
+** pool:map(source, array [, size]): calls the job function over each
+** element of 'array', in jobs of 'size' elements, and returns the
+** array of the (first) results. Raises the error of the first job
+** that fails, after all jobs finish.
+*/
+static int pool_map (lua_State *L) {
+  Pool *P = topool(L);
+  lua_Integer n, size, njobs, first, k, got;
+  size_t l;
+  const char *src = luaL_checklstring(L, 2, &l);
+  int failed = 0;
+  MBuffer *B;
+  Msg **tail;
+  luaL_checktype(L, 3, LUA_TTABLE);
+  n = luaL_len(L, 3);
+  size = luaL_optinteger(L, 4, 0);
+  luaL_argcheck(L, size >= 0, 4, "invalid job size");
+  lua_settop(L, 4);
+  if (size == 0)
+    size = (n + LUAI_MAPSPLIT * P->n - 1) / (LUAI_MAPSPLIT * P->n);
+  if (size == 0) size = 1;
+  njobs = (n + size - 1) / size;
+  B = newmbuff(L);  /* index 5 */
+  while (P->batch != NULL) {  /* leftovers of an interrupted 'map' */
+    Msg *m = P->batch;
+    P->batch = m->next;
+    freemsg(m);
+  }
+  tail = &P->batch;
+  first = P->lastid + 1;
+  for (k = 0; k < njobs; k++) {  /* build all jobs before sending any */
+    lua_Integer i, start = k * size;
+    lua_Integer count = (n - start < size) ? n - start : size;
+    B->n = 0;
+    addheader(L, B, T_STRING, l);
+    addmbuff(L, B, src, l);
+    lua_pushinteger(L, count);
+    encode(L, B, 6, 0);
+    lua_pop(L, 1);
+    for (i = 1; i <= count; i++) {
+      lua_geti(L, 3, start + i);
+      encode(L, B, 6, 0);
+      lua_pop(L, 1);
+    }
+    *tail = newmsg(L, B, M_MAP, first + k);
+    tail = &(*tail)->next;
+  }
+  while (P->batch != NULL) {
+    Msg *m = P->batch;
+    P->batch = m->next;
+    dispatch(P, m);
+  }
+  P->lastid += njobs;
+  lua_createtable(L, (int)(n < INT_MAX ? n : INT_MAX), 0);  /* index 6 */
+  lua_pushnil(L);  /* index 7: first error */
+  for (got = 0; got < njobs; ) {
+    Msg *m = q_take(&P->replies);
+    Reader R;
+    if (m->id < first || m->id >= first + njobs) {  /* reply to 'run'? */
+      m->next = NULL;
+      *P->stashtail = m;
+      P->stashtail = &m->next;
+      continue;
+    }
+    got++;
+    P->pending--;
+    k = m->id - first;
+    takemsg(B, m, &R);
+    if (R.p == R.end || *R.p != T_TRUE) {
+      if (!failed) {
+        failed = 1;
+        if (R.p == R.end)
+          lua_pushliteral(L, "not enough memory");
+        else {
+          R.p++;
+          decode(L, &R, 0);
+        }
+        lua_replace(L, 7);
+      }
+    }
+    else if (!failed) {
+      lua_Integer i = k * size;
+      R.p++;
+      while (R.p < R.end) {
+        decode(L, &R, 0);
+        lua_rawseti(L, 6, ++i);
+      }
+    }
+  }
+  if (failed)
+    return lua_error(L);
+  lua_settop(L, 6);
+  return 1;
+}
+
+
+static int pool_close (lua_State *L) {
+  Pool *P = topool(L);
+  closepool(P);
+  return 0;
+}
+
+
+static int pool_gc (lua_State *L) {
+  Pool *P = (Pool *)luaL_checkudata(L, 1, POOL);
+  if (!P->closed)
+    closepool(P);
+  return 0;
+}
+
+
+static int pool_len (lua_State *L) {
+  Pool *P = (Pool *)luaL_checkudata(L, 1, POOL);
+  lua_pushinteger(L, P->n);
+  return 1;
+}
+
+
+static int pool_tostring (lua_State *L) {
+  Pool *P = (Pool *)luaL_checkudata(L, 1, POOL);
+  if (P->closed)
+    lua_pushliteral(L, "pool (closed)");
+  else
+    lua_pushfstring(L, "pool (%p)", (void *)P);
+  return 1;
+}
+
+
+static const luaL_Reg threads_funcs[] = {
+  {"pool", threads_pool},
+  {NULL, NULL}
+};
+
+
+static const luaL_Reg poolmeth[] = {
+  {"run", pool_run},
+  {"wait", pool_wait},
+  {"map", pool_map},
+  {"close", pool_close},
+  {NULL, NULL}
+};
+
+
+static const luaL_Reg poolmeta[] = {
+  {"__index", NULL},  /* place holder */
+  {"__gc", pool_gc},
+  {"__len", pool_len},
+  {"__tostring", pool_tostring},
+  {NULL, NULL}
+};
+
+
+static void createmeta (lua_State *L) {
+  luaL_newmetatable(L, POOL);
+  luaL_setfuncs(L, poolmeta, 0);
+  luaL_newlib(L, poolmeth);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+  luaL_newmetatable(L, MBUFFER);
+  lua_pushcfunction(L, mbuff_gc);
+  lua_setfield(L, -2, "__gc");
+  lua_pop(L, 1);
+}
+
+#else				/* }{ */
+
+static int threads_notsupported (lua_State *L) {
+  return luaL_error(L, "'threads' not supported");
+}
+
+
+static const luaL_Reg threads_funcs[] = {
+  {"pool", threads_notsupported},
+  {NULL, NULL}
+};
+
+
+#define createmeta(L)	((void)L)
+
+#endif				/* } */
+
+
+LUAMOD_API int luaopen_threads (lua_State *L) {
+  luaL_newlib(L, threads_funcs);
+  createmeta(L);
+  return 1;
+}
+
@@ -100,6 +100,9 @@ typedef LUA_UNSIGNED lua_Unsigned;
 /* type for continuation-function contexts */
 typedef LUA_KCONTEXT lua_KContext;
 
+/* type for interned keys (see 'lua_internkey') */
+typedef const void *lua_Key;
+
 
 /*
 ** Type for C functions registered with Lua
@@ -190,6 +193,11 @@ LUA_API void	       *(lua_touserdata) (lua_State *L, int idx);
 LUA_API lua_State      *(lua_tothread) (lua_State *L, int idx);
 LUA_API const void     *(lua_topointer) (lua_State *L, int idx);
 
+LUA_API int             (lua_tonumbers) (lua_State *L, int idx, int n,
+                                         lua_Number *out);
+LUA_API int             (lua_tointegers) (lua_State *L, int idx, int n,
+                                          lua_Integer *out);
+
 
 /*
 ** Comparison and arithmetic functions
@@ -232,6 +240,7 @@ LUA_API const char *(lua_pushvfstring) (lua_State *L, const char *fmt,
                                                       va_list argp);
 LUA_API const char *(lua_pushfstring) (lua_State *L, const char *fmt, ...);
 LUA_API void  (lua_pushcclosure) (lua_State *L, lua_CFunction fn, int n);
+LUA_API void  (lua_pushleaffunction) (lua_State *L, lua_CFunction fn);
 LUA_API void  (lua_pushboolean) (lua_State *L, int b);
 LUA_API void  (lua_pushlightuserdata) (lua_State *L, void *p);
 LUA_API int   (lua_pushthread) (lua_State *L);
@@ -243,6 +252,9 @@ LUA_API int   (lua_pushthread) (lua_State *L);
 LUA_API int (lua_getglobal) (lua_State *L, const char *name);
 LUA_API int (lua_gettable) (lua_State *L, int idx);
 LUA_API int (lua_getfield) (lua_State *L, int idx, const char *k);
+LUA_API int (lua_getfields) (lua_State *L, int idx, const char *const *k,
+                             int n);
+LUA_API int (lua_getfieldk) (lua_State *L, int idx, lua_Key k);
 LUA_API int (lua_geti) (lua_State *L, int idx, lua_Integer n);
 LUA_API int (lua_rawget) (lua_State *L, int idx);
 LUA_API int (lua_rawgeti) (lua_State *L, int idx, lua_Integer n);
@@ -260,6 +272,7 @@ LUA_API int  (lua_getuservalue) (lua_State *L, int idx);
 LUA_API void  (lua_setglobal) (lua_State *L, const char *name);
 LUA_API void  (lua_settable) (lua_State *L, int idx);
 LUA_API void  (lua_setfield) (lua_State *L, int idx, const char *k);
+LUA_API void  (lua_setfieldk) (lua_State *L, int idx, lua_Key k);
 LUA_API void  (lua_seti) (lua_State *L, int idx, lua_Integer n);
 LUA_API void  (lua_rawset) (lua_State *L, int idx);
 LUA_API void  (lua_rawseti) (lua_State *L, int idx, lua_Integer n);
@@ -268,6 +281,28 @@ LUA_API int   (lua_setmetatable) (lua_State *L, int objindex);
 LUA_API void  (lua_setuservalue) (lua_State *L, int idx);
 
 
+/*
+** tables <-> C structs
+*/
+#define LUA_FINTEGER	0	/* lua_Integer */
+#define LUA_FNUMBER	1	/* lua_Number */
+#define LUA_FINT	2	/* int */
+#define LUA_FFLOAT	3	/* float */
+#define LUA_FBOOLEAN	4	/* int, 0 or 1 */
+#define LUA_FSTRING	5	/* const char *, owned by the table */
+
+typedef struct lua_Field {
+  const char *name;  /* key in the table */
+  int type;  /* LUA_F* */
+  size_t offset;  /* 'offsetof' the field in the struct */
+} lua_Field;
+
+LUA_API int   (lua_getstruct) (lua_State *L, int idx, void *p,
+                               const lua_Field *f, int n);
+LUA_API void  (lua_setstruct) (lua_State *L, int idx, const void *p,
+                               const lua_Field *f, int n);
+
+
 /*
 ** 'load' and 'call' functions (load and run Lua code)
 */
@@ -283,6 +318,7 @@ LUA_API int   (lua_load) (lua_State *L, lua_Reader reader, void *dt,
                           const char *chunkname, const char *mode);
 
 LUA_API int (lua_dump) (lua_State *L, lua_Writer writer, void *data, int strip);
+LUA_API int (lua_heapsnapshot) (lua_State *L, lua_Writer writer, void *data);
 
 
 /*
@@ -327,9 +363,14 @@ LUA_API void  (lua_len)    (lua_State *L, int idx);
 
 LUA_API size_t   (lua_stringtonumber) (lua_State *L, const char *s);
 
+LUA_API lua_Key  (lua_internkey) (lua_State *L, const char *k);
+
 LUA_API lua_Alloc (lua_getallocf) (lua_State *L, void **ud);
 LUA_API void      (lua_setallocf) (lua_State *L, lua_Alloc f, void *ud);
 
+LUA_API void (lua_allocprofile) (lua_State *L, size_t interval);
+LUA_API int  (lua_allocsites) (lua_State *L);
+
 
 
 /*
@@ -440,6 +481,8 @@ LUA_API lua_Hook (lua_gethook) (lua_State *L);
 LUA_API int (lua_gethookmask) (lua_State *L);
 LUA_API int (lua_gethookcount) (lua_State *L);
 
+LUA_API int (lua_vmstats) (lua_State *L, int reset);
+
 
 struct lua_Debug {
   int event;
@@ -19,9 +19,25 @@
 #include "lauxlib.h"
 
 #include "lobject.h"
+#include "lopt.h"
 #include "lstate.h"
 #include "lundump.h"
 
+/*
+** threads used by '-j': Windows threads or POSIX threads; elsewhere
+** '-j' is accepted but files are compiled one after another
+*/
+#if defined(_WIN32)
+#include <windows.h>
+#define LUAC_THREADS	1
+typedef HANDLE l_thread;
+#elif !defined(LUA_USE_C89) && \
+      (defined(LUA_USE_POSIX) || defined(__unix__) || defined(__APPLE__))
+#include <pthread.h>
+#define LUAC_THREADS	1
+typedef pthread_t l_thread;
+#endif
+
 static void PrintFunction(const Proto* f, int full);
 #define luaU_print	PrintFunction
 
@@ -31,6 +47,8 @@ static void PrintFunction(const Proto* f, int full);
 static int listing=0;			/* list bytecodes? */
 static int dumping=1;			/* dump bytecodes? */
 static int stripping=0;			/* strip debug information? */
+static int optimizing=0;		/* run bytecode optimizer? */
+static int jobs=1;			/* files compiled in parallel */
 static char Output[]={ OUTPUT };	/* default output file name */
 static const char* output=Output;	/* actual output file name */
 static const char* progname=PROGNAME;	/* actual program name */
@@ -57,6 +75,8 @@ static void usage(const char* message)
   "usage: %s [options] [filenames]\n"
   "Available options are:\n"
   "  -l       list (use -l -l for full listing)\n"
+  "  -j n     compile up to 'n' files in parallel\n"
+  "  -O       optimize bytecodes\n"
   "  -o name  output to file 'name' (default is \"%s\")\n"
   "  -p       parse only\n"
   "  -s       strip debug information\n"
@@ -88,6 +108,12 @@ static int doargs(int argc, char* argv[])
    break;
   else if (IS("-l"))			/* list */
    ++listing;
+  else if (IS("-j"))			/* parallel jobs */
+  {
+   const char* n=argv[++i];
+   if (n==NULL || !isdigit((unsigned char)*n) || (jobs=atoi(n))<1)
+    usage("'-j' needs a positive number");
+  }
   else if (IS("-o"))			/* output file */
   {
    output=argv[++i];
@@ -95,6 +121,8 @@ static int doargs(int argc, char* argv[])
     usage("'-o' needs argument");
    if (IS("-")) output=NULL;
   }
+  else if (IS("-O"))			/* optimize */
+   optimizing=1;
   else if (IS("-p"))			/* parse only */
    dumping=0;
   else if (IS("-s"))			/* strip debug information */
@@ -162,6 +190,159 @@ static int writer(lua_State* L, const void* p, size_t size, void* u)
  return (fwrite(p,size,1,(FILE*)u)!=1) && (size!=0);
 }
 
+/*
+** {======================================================
+** Parallel compilation ('-j'): each worker thread has its own state,
+** takes the next file, parses it and dumps it (with debug information)
+** into memory. The main state then undumps the results in command-line
+** order, so the output does not depend on scheduling.
+** =======================================================
+*/
+
+typedef struct Chunk
+{
+ const char* filename;		/* NULL for stdin */
+ char* data;			/* dumped function or error message */
+ size_t size;
+ int status;
+} Chunk;
+
+typedef struct Pool
+{
+ Chunk* chunk;
+ int n;
+ int next;			/* next chunk to compile */
+#if defined(_WIN32)
+ CRITICAL_SECTION lock;
+#elif defined(LUAC_THREADS)
+ pthread_mutex_t lock;
+#endif
+} Pool;
+
+static int nextchunk(Pool* P)
+{
+ int i;
+#if defined(_WIN32)
+ EnterCriticalSection(&P->lock);
+ i=P->next++;
+ LeaveCriticalSection(&P->lock);
+#elif defined(LUAC_THREADS)
+ pthread_mutex_lock(&P->lock);
+ i=P->next++;
+ pthread_mutex_unlock(&P->lock);
+#else
+ i=P->next++;
+#endif
+ return i;
+}
+
+static int chunkwriter(lua_State* L, const void* p, size_t size, void* u)
+{
+ Chunk* c=(Chunk*)u;
+ char* data;
+ UNUSED(L);
+ data=(char*)realloc(c->data,c->size+size);
+ if (data==NULL && c->size+size>0) return 1;
+ if (size>0) memcpy(data+c->size,p,size);
+ c->data=data;
+ c->size+=size;
+ return 0;
+}
+
+static void seterror(Chunk* c, const char* message)
+{
+ c->status=LUA_ERRERR;
+ c->size=strlen(message);
+ c->data=(char*)malloc(c->size+1);
+ if (c->data!=NULL) memcpy(c->data,message,c->size+1);
+}
+
+static void compile(lua_State* L, Chunk* c)
+{
+ if (L==NULL)
+ {
+  seterror(c,"cannot create state: not enough memory");
+  return;
+ }
+ if (luaL_loadfile(L,c->filename)!=LUA_OK)
+  seterror(c,lua_tostring(L,-1));
+ else if (lua_dump(L,chunkwriter,c,0)!=0)
+ {
+  free(c->data);
+  c->data=NULL;
+  seterror(c,"not enough memory");
+ }
+ lua_settop(L,0);
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI worker(LPVOID ud)
+#else
+static void* worker(void* ud)
+#endif
+{
+ Pool* P=(Pool*)ud;
+ lua_State* L=luaL_newstate();
+ int i;
+ while ((i=nextchunk(P))<P->n) compile(L,&P->chunk[i]);
+ if (L!=NULL) lua_close(L);
+ return 0;
+}
+
+static void runpool(Pool* P, int nthreads)
+{
+#if defined(LUAC_THREADS)
+ l_thread* thread=(l_thread*)malloc(nthreads*sizeof(l_thread));
+ int i,started=0;
+ if (thread==NULL) fatal("not enough memory");
+#if defined(_WIN32)
+ InitializeCriticalSection(&P->lock);
+ for (i=0; i<nthreads; i++)
+  if ((thread[started]=CreateThread(NULL,0,worker,P,0,NULL))!=NULL) started++;
+ if (started==0) worker(P);			/* no threads; do it here */
+ for (i=0; i<started; i+=MAXIMUM_WAIT_OBJECTS)	/* it waits for at most 64 */
+  WaitForMultipleObjects(started-i<MAXIMUM_WAIT_OBJECTS ? started-i :
+   MAXIMUM_WAIT_OBJECTS,thread+i,TRUE,INFINITE);
+ for (i=0; i<started; i++) CloseHandle(thread[i]);
+ DeleteCriticalSection(&P->lock);
+#else
+ pthread_mutex_init(&P->lock,NULL);
+ for (i=0; i<nthreads; i++)
+  if (pthread_create(&thread[started],NULL,worker,P)==0) started++;
+ if (started==0) worker(P);			/* no threads; do it here */
+ for (i=0; i<started; i++) pthread_join(thread[i],NULL);
+ pthread_mutex_destroy(&P->lock);
+#endif
+ free(thread);
+#else
+ UNUSED(nthreads);
+ worker(P);
+#endif
+}
+
+static void loadparallel(lua_State* L, int argc, char* argv[])
+{
+ Pool P;
+ int i;
+ P.chunk=(Chunk*)calloc(argc,sizeof(Chunk));
+ if (P.chunk==NULL) fatal("not enough memory");
+ P.n=argc;
+ P.next=0;
+ for (i=0; i<argc; i++) P.chunk[i].filename=IS("-") ? NULL : argv[i];
+ runpool(&P,jobs<argc ? jobs : argc);
+ for (i=0; i<argc; i++)				/* first error wins */
+ {
+  Chunk* c=&P.chunk[i];
+  if (c->status!=LUA_OK) fatal(c->data!=NULL ? c->data : "not enough memory");
+  if (luaL_loadbufferx(L,c->data,c->size,argv[i],"b")!=LUA_OK)
+   fatal(lua_tostring(L,-1));
+  free(c->data);
+ }
+ free(P.chunk);
+}
+
+/* }====================================================== */
+
 static int pmain(lua_State* L)
 {
  int argc=(int)lua_tointeger(L,1);
@@ -169,12 +350,15 @@ static int pmain(lua_State* L)
  const Proto* f;
  int i;
  if (!lua_checkstack(L,argc)) fatal("too many input files");
- for (i=0; i<argc; i++)
+ if (jobs>1 && argc>1)
+  loadparallel(L,argc,argv);
+ else for (i=0; i<argc; i++)
  {
   const char* filename=IS("-") ? NULL : argv[i];
   if (luaL_loadfile(L,filename)!=LUA_OK) fatal(lua_tostring(L,-1));
  }
  f=combine(L,argc);
+ if (optimizing) luaK_optimize(L,(Proto*)f);
  if (listing) luaU_print(f,listing>1);
  if (dumping)
  {
@@ -332,6 +516,7 @@ static void PrintCode(const Proto* f)
     printf("\t; %s",UPVALNAME(b));
     break;
    case OP_GETTABUP:
+   case OP_GETTABUP2:
     printf("\t; %s",UPVALNAME(b));
     if (ISK(c)) { printf(" "); PrintConstant(f,INDEXK(c)); }
     break;
@@ -341,6 +526,7 @@ static void PrintCode(const Proto* f)
     if (ISK(c)) { printf(" "); PrintConstant(f,INDEXK(c)); }
     break;
    case OP_GETTABLE:
+   case OP_GETTABLE2:
    case OP_SELF:
     if (ISK(c)) { printf("\t; "); PrintConstant(f,INDEXK(c)); }
     break;
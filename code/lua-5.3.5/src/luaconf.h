@@ -223,6 +223,16 @@
 #define LUA_DIRSEP	"/"
 #endif
 
+
+/*
+@@ LUA_USE_PATHCACHE makes 'require' keep a cache of the directories it
+** searches along 'package.path' and 'package.cpath'. With the cache
+** on, each directory is read only once and modules are looked up in
+** its listing, so module files added or removed later are not seen
+** until 'package.flushcache' is called.
+*/
+/* #define LUA_USE_PATHCACHE */
+
 /* }================================================================== */
 
 
@@ -240,18 +250,27 @@
 ** For instance, if you want to create one Windows DLL with the core and
 ** the libraries, you may want to use the following definition (define
 ** LUA_BUILD_AS_DLL to get it).
+** When Lua is compiled as C++ (so that errors use C++ exceptions; see
+** LUAI_THROW in ldo.c), the API keeps C linkage, so that C code and
+** users of 'lua.hpp' link with either build.
 */
+#if defined(__cplusplus)
+#define LUA_EXTERN	extern "C"
+#else
+#define LUA_EXTERN	extern
+#endif
+
 #if defined(LUA_BUILD_AS_DLL)	/* { */
 
 #if defined(LUA_CORE) || defined(LUA_LIB)	/* { */
-#define LUA_API __declspec(dllexport)
+#define LUA_API LUA_EXTERN __declspec(dllexport)
 #else						/* }{ */
-#define LUA_API __declspec(dllimport)
+#define LUA_API LUA_EXTERN __declspec(dllimport)
 #endif						/* } */
 
 #else				/* }{ */
 
-#define LUA_API		extern
+#define LUA_API		LUA_EXTERN
 
 #endif				/* } */
 
@@ -0,0 +1,457 @@
+/*
+** Lua heap snapshot analyzer (reads files written by debug.heapsnapshot)
+** See Copyright Notice in lua.h
+*/
+
+#define luaheap_c
+#define LUA_CORE
+
+#include "lprefix.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "lgc.h"
+#include "lobject.h"
+
+/*
+** The snapshot is read three times and never held in memory: the first
+** pass collects objects (sorted by address afterwards), the second
+** fills the references as indices, and the last one fetches the labels
+** of the objects reported. Dominators come from the iterative algorithm
+** of Cooper, Harvey and Kennedy on the graph rooted at a virtual node
+** whose successors are the roots of the snapshot; the retained size of
+** an object is the sum of the sizes in its dominator subtree.
+*/
+
+#define PROGNAME	"luaheap"	/* default program name */
+
+#define NONE	UINT_MAX		/* no object / not reached */
+
+typedef struct Object {
+ size_t addr;
+ size_t size;
+ size_t nrefs;				/* references (in the snapshot) */
+ int tag;
+} Object;
+
+static const char* progname=PROGNAME;	/* actual program name */
+static const char* input=NULL;		/* snapshot file name */
+static int top=20;			/* number of objects listed */
+static FILE* in;
+
+static Object* obj;			/* objects, sorted by address */
+static unsigned nobj;			/* number of objects */
+static unsigned root;			/* virtual root (== nobj) */
+static size_t* first;			/* refs of 'i': first[i] .. first[i+1] */
+static unsigned* ref;
+static size_t* pfirst;			/* same for predecessors */
+static unsigned* pred;
+static unsigned* order;			/* reached objects, reverse postorder */
+static unsigned nreached;
+static unsigned* rpo;			/* position of each object in 'order' */
+static unsigned* idom;			/* immediate dominators */
+static size_t* retained;
+
+static void fatal(const char* message)
+{
+ fprintf(stderr,"%s: %s\n",progname,message);
+ exit(EXIT_FAILURE);
+}
+
+static void cannot(const char* what)
+{
+ fprintf(stderr,"%s: cannot %s %s: %s\n",progname,what,input,strerror(errno));
+ exit(EXIT_FAILURE);
+}
+
+static void usage(const char* message)
+{
+ if (*message=='-')
+  fprintf(stderr,"%s: unrecognized option '%s'\n",progname,message);
+ else
+  fprintf(stderr,"%s: %s\n",progname,message);
+ fprintf(stderr,
+  "usage: %s [options] snapshot\n"
+  "Available options are:\n"
+  "  -n count list the 'count' objects that retain most memory (default %d)\n"
+  ,progname,top);
+ exit(EXIT_FAILURE);
+}
+
+#define IS(s)	(strcmp(argv[i],s)==0)
+
+static void doargs(int argc, char* argv[])
+{
+ int i;
+ if (argv[0]!=NULL && *argv[0]!=0) progname=argv[0];
+ for (i=1; i<argc; i++)
+ {
+  if (*argv[i]!='-')			/* snapshot file */
+   break;
+  else if (IS("-n"))			/* number of objects */
+  {
+   const char* n=argv[++i];
+   if (n==NULL || !isdigit((unsigned char)*n)) usage("'-n' needs a number");
+   top=atoi(n);
+  }
+  else					/* unknown option */
+   usage(argv[i]);
+ }
+ if (i!=argc-1) usage("no snapshot given");
+ input=argv[i];
+}
+
+static void* allocate(size_t n, size_t size)
+{
+ void* p=calloc(n+1,size);
+ if (p==NULL) fatal("not enough memory");
+ return p;
+}
+
+/*
+** {======================================================
+** Reading the snapshot
+** =======================================================
+*/
+
+static int readbyte(void)
+{
+ int c=getc(in);
+ if (c==EOF) fatal(ferror(in) ? "read error" : "truncated snapshot");
+ return c;
+}
+
+static size_t readsize(void)
+{
+ size_t x=0;
+ int shift=0;
+ int c;
+ do
+ {
+  c=readbyte();
+  x|=(size_t)(c&0x7f)<<shift;
+  shift+=7;
+ } while (c&0x80);
+ return x;
+}
+
+/* labels longer than 'Label' (a bad snapshot) are cut */
+static void readlabel(char* b)
+{
+ size_t i,n=readsize();
+ for (i=0; i<n; i++)
+ {
+  int c=readbyte();
+  if (b!=NULL && i<LUAI_HEAPLABEL) b[i]=isprint(c) ? (char)c : '.';
+ }
+ if (b!=NULL) b[n<LUAI_HEAPLABEL ? n : LUAI_HEAPLABEL]=0;
+}
+
+/* start a pass: check the header (roots come next) */
+static void rewindsnapshot(void)
+{
+ const char* s=HEAPSIGNATURE;
+ rewind(in);
+ for (; *s; s++)
+  if (readbyte()!=(unsigned char)*s) fatal("not a heap snapshot");
+ if (readbyte()!=HEAPVERSION) fatal("snapshot version mismatch");
+ if (readbyte()!=HS_ROOTS) fatal("bad snapshot");
+}
+
+static unsigned find(size_t addr)
+{
+ unsigned lo=0, hi=nobj;
+ while (lo<hi)
+ {
+  unsigned m=lo+(hi-lo)/2;
+  if (obj[m].addr<addr) lo=m+1; else hi=m;
+ }
+ return (lo<nobj && obj[lo].addr==addr) ? lo : NONE;
+}
+
+static int addrcmp(const void* a, const void* b)
+{
+ size_t x=((const Object*)a)->addr, y=((const Object*)b)->addr;
+ return (x>y)-(x<y);
+}
+
+/* first pass: objects and number of references */
+static void readobjects(void)
+{
+ unsigned size=1024;
+ size_t nroots=0;
+ int tag;
+ rewindsnapshot();
+ while (readsize()!=0) nroots++;
+ obj=(Object*)allocate(size,sizeof(Object));
+ while ((tag=readbyte())!=HS_END)
+ {
+  Object* o;
+  if (nobj==size)
+  {
+   if (size>=UINT_MAX/2) fatal("too many objects");
+   size*=2;
+   obj=(Object*)realloc(obj,(size+1)*sizeof(Object));
+   if (obj==NULL) fatal("not enough memory");
+  }
+  o=&obj[nobj++];
+  o->tag=tag;
+  o->addr=readsize();
+  o->size=readsize();
+  o->nrefs=0;
+  readlabel(NULL);
+  while (readsize()!=0) o->nrefs++;
+ }
+ qsort(obj,nobj,sizeof(Object),addrcmp);
+ root=nobj;
+ obj[root].addr=obj[root].size=0;
+ obj[root].tag=0;
+ obj[root].nrefs=nroots;
+}
+
+/* second pass: references as indices */
+static void readrefs(void)
+{
+ unsigned i;
+ size_t k,a;
+ first=(size_t*)allocate(nobj+1,sizeof(size_t));
+ for (i=0; i<=root; i++) first[i+1]=first[i]+obj[i].nrefs;
+ ref=(unsigned*)allocate(first[root+1],sizeof(unsigned));
+ rewindsnapshot();
+ for (k=first[root]; (a=readsize())!=0; k++) ref[k]=find(a);
+ while (readbyte()!=HS_END)
+ {
+  i=find(readsize());
+  readsize();
+  readlabel(NULL);
+  for (k=first[i]; (a=readsize())!=0; k++) ref[k]=find(a);
+ }
+}
+
+typedef char Label[LUAI_HEAPLABEL+1];
+
+/* last pass: labels of the 'n' objects in 'which' */
+static void readlabels(const unsigned* which, unsigned n, Label* labels)
+{
+ Label l;
+ rewindsnapshot();
+ while (readsize()!=0) ;
+ while (readbyte()!=HS_END)
+ {
+  unsigned i=find(readsize());
+  unsigned j;
+  readsize();
+  readlabel(l);
+  for (j=0; j<n; j++)
+   if (which[j]==i) strcpy(labels[j],l);
+  while (readsize()!=0) ;
+ }
+}
+
+/* }====================================================== */
+
+/*
+** {======================================================
+** Dominators
+** =======================================================
+*/
+
+/* number the objects reached from the root in reverse postorder */
+static void dfs(void)
+{
+ unsigned* stack=(unsigned*)allocate(nobj+1,sizeof(unsigned));
+ size_t* next=(size_t*)allocate(nobj+1,sizeof(size_t));
+ unsigned i,sp=0,npost=0;
+ rpo=(unsigned*)allocate(nobj+1,sizeof(unsigned));
+ order=(unsigned*)allocate(nobj+1,sizeof(unsigned));
+ for (i=0; i<=root; i++) rpo[i]=NONE;
+ stack[sp++]=root; next[root]=first[root]; rpo[root]=0;
+ while (sp>0)
+ {
+  unsigned v=stack[sp-1];
+  if (next[v]<first[v+1])
+  {
+   unsigned w=ref[next[v]++];
+   if (w!=NONE && rpo[w]==NONE)
+   {
+    rpo[w]=0;				/* on stack */
+    next[w]=first[w];
+    stack[sp++]=w;
+   }
+  }
+  else
+  {
+   order[npost++]=v;			/* postorder */
+   sp--;
+  }
+ }
+ nreached=npost;
+ for (i=0; i<npost/2; i++)		/* reverse it */
+ {
+  unsigned t=order[i];
+  order[i]=order[npost-1-i];
+  order[npost-1-i]=t;
+ }
+ for (i=0; i<npost; i++) rpo[order[i]]=i;
+ free(stack);
+ free(next);
+}
+
+static void predecessors(void)
+{
+ unsigned i;
+ size_t k;
+ size_t* fill;
+ pfirst=(size_t*)allocate(nobj+1,sizeof(size_t));
+ for (i=0; i<=root; i++)
+  if (rpo[i]!=NONE)
+   for (k=first[i]; k<first[i+1]; k++)
+    if (ref[k]!=NONE) pfirst[ref[k]+1]++;
+ for (i=0; i<=root; i++) pfirst[i+1]+=pfirst[i];
+ pred=(unsigned*)allocate(pfirst[root+1],sizeof(unsigned));
+ fill=(size_t*)allocate(nobj+1,sizeof(size_t));
+ memcpy(fill,pfirst,(nobj+1)*sizeof(size_t));
+ for (i=0; i<=root; i++)
+  if (rpo[i]!=NONE)
+   for (k=first[i]; k<first[i+1]; k++)
+    if (ref[k]!=NONE) pred[fill[ref[k]]++]=i;
+ free(fill);
+}
+
+static unsigned intersect(unsigned a, unsigned b)
+{
+ while (a!=b)
+ {
+  while (rpo[a]>rpo[b]) a=idom[a];
+  while (rpo[b]>rpo[a]) b=idom[b];
+ }
+ return a;
+}
+
+static void dominators(void)
+{
+ int changed=1;
+ unsigned i;
+ idom=(unsigned*)allocate(nobj+1,sizeof(unsigned));
+ for (i=0; i<=root; i++) idom[i]=NONE;
+ idom[root]=root;
+ while (changed)
+ {
+  changed=0;
+  for (i=1; i<nreached; i++)
+  {
+   unsigned b=order[i];
+   unsigned d=NONE;
+   size_t k;
+   for (k=pfirst[b]; k<pfirst[b+1]; k++)
+   {
+    unsigned p=pred[k];
+    if (idom[p]!=NONE) d=(d==NONE) ? p : intersect(p,d);
+   }
+   if (idom[b]!=d) { idom[b]=d; changed=1; }
+  }
+ }
+ retained=(size_t*)allocate(nobj+1,sizeof(size_t));
+ for (i=0; i<nobj; i++) retained[i]=obj[i].size;
+ for (i=nreached-1; i>0; i--) retained[idom[order[i]]]+=retained[order[i]];
+}
+
+/* }====================================================== */
+
+static const char* tagname(int tag)
+{
+ switch (tag)
+ {
+  case LUA_TSHRSTR: case LUA_TLNGSTR: return "string";
+  case LUA_TTABLE: return "table";
+  case LUA_TLCL: return "function";
+  case LUA_TCCL: return "C function";
+  case LUA_TUSERDATA: return "userdata";
+  case LUA_TTHREAD: return "thread";
+  case LUA_TPROTO: return "proto";
+  default: return "?";
+ }
+}
+
+static const char* objtype(unsigned i)
+{
+ return (i==root) ? "(roots)" : tagname(obj[i].tag);
+}
+
+static int retainedcmp(const void* a, const void* b)
+{
+ size_t x=retained[*(const unsigned*)a], y=retained[*(const unsigned*)b];
+ return (x<y)-(x>y);
+}
+
+static void report(void)
+{
+ static const int tags[]={ LUA_TTABLE, LUA_TSHRSTR, LUA_TLCL, LUA_TCCL,
+  LUA_TUSERDATA, LUA_TTHREAD, LUA_TPROTO };
+ unsigned* sorted=(unsigned*)allocate(nreached,sizeof(unsigned));
+ unsigned* which;
+ Label* labels;
+ size_t total=0,unreached=0;
+ unsigned i,n=0;
+ int t;
+ for (i=0; i<nobj; i++)
+ {
+  total+=obj[i].size;
+  if (rpo[i]==NONE) unreached+=obj[i].size;
+ }
+ printf("%u objects, %lu bytes (%lu bytes not reachable from the roots)\n\n",
+  nobj,(unsigned long)total,(unsigned long)unreached);
+ printf("%-12s %10s %14s\n","type","count","bytes");
+ for (t=0; t<(int)(sizeof(tags)/sizeof(tags[0])); t++)
+ {
+  size_t count=0,bytes=0;
+  for (i=0; i<nobj; i++)
+   if (strcmp(tagname(obj[i].tag),tagname(tags[t]))==0)
+   {
+    count++;
+    bytes+=obj[i].size;
+   }
+  if (count>0)
+   printf("%-12s %10lu %14lu\n",tagname(tags[t]),(unsigned long)count,
+    (unsigned long)bytes);
+ }
+ for (i=1; i<nreached; i++) sorted[n++]=order[i];
+ qsort(sorted,n,sizeof(unsigned),retainedcmp);
+ if ((unsigned)top<n) n=top;
+ which=(unsigned*)allocate(2*n,sizeof(unsigned));
+ labels=(Label*)allocate(2*n,sizeof(Label));
+ for (i=0; i<n; i++) { which[2*i]=sorted[i]; which[2*i+1]=idom[sorted[i]]; }
+ readlabels(which,2*n,labels);
+ printf("\n%14s %12s  %-10s %-32s %s\n","retained","size","type","label",
+  "dominator");
+ for (i=0; i<n; i++)
+ {
+  unsigned o=which[2*i],d=which[2*i+1];
+  printf("%14lu %12lu  %-10s %-32s %s %s\n",(unsigned long)retained[o],
+   (unsigned long)obj[o].size,objtype(o),labels[2*i],objtype(d),
+   d==root ? "" : labels[2*i+1]);
+ }
+ free(sorted); free(which); free(labels);
+}
+
+int main(int argc, char* argv[])
+{
+ doargs(argc,argv);
+ in=fopen(input,"rb");
+ if (in==NULL) cannot("open");
+ readobjects();
+ readrefs();
+ dfs();
+ predecessors();
+ dominators();
+ report();
+ fclose(in);
+ return EXIT_SUCCESS;
+}
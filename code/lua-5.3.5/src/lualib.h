@@ -47,6 +47,24 @@ LUAMOD_API int (luaopen_debug) (lua_State *L);
 #define LUA_LOADLIBNAME	"package"
 LUAMOD_API int (luaopen_package) (lua_State *L);
 
+#define LUA_PROFLIBNAME	"profile"
+LUAMOD_API int (luaopen_profile) (lua_State *L);
+
+#define LUA_AIOLIBNAME	"aio"
+LUAMOD_API int (luaopen_aio) (lua_State *L);
+
+#define LUA_SCHEDLIBNAME	"sched"
+LUAMOD_API int (luaopen_sched) (lua_State *L);
+
+#define LUA_THREADSLIBNAME	"threads"
+LUAMOD_API int (luaopen_threads) (lua_State *L);
+
+#define LUA_SERIALIZELIBNAME	"serialize"
+LUAMOD_API int (luaopen_serialize) (lua_State *L);
+
+#define LUA_JSONLIBNAME	"json"
+LUAMOD_API int (luaopen_json) (lua_State *L);
+
 
 /* open all previous libraries */
 LUALIB_API void (luaL_openlibs) (lua_State *L);
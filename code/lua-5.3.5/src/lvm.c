@@ -161,6 +161,7 @@ void luaV_finishget (lua_State *L, const TValue *t, TValue *key, StkId val,
                       const TValue *slot) {
   int loop;  /* counter to avoid infinite loops */
   const TValue *tm;  /* metamethod */
+  luai_vmstat(L, finishget, 1);
   for (loop = 0; loop < MAXTAGLOOP; loop++) {
     if (slot == NULL) {  /* 't' is not a table? */
       lua_assert(!ttistable(t));
@@ -203,6 +204,7 @@ void luaV_finishget (lua_State *L, const TValue *t, TValue *key, StkId val,
 void luaV_finishset (lua_State *L, const TValue *t, TValue *key,
                      StkId val, const TValue *slot) {
   int loop;  /* counter to avoid infinite loops */
+  luai_vmstat(L, finishset, 1);
   for (loop = 0; loop < MAXTAGLOOP; loop++) {
     const TValue *tm;  /* '__newindex' metamethod */
     if (slot != NULL) {  /* is 't' a table? */
@@ -421,7 +423,7 @@ int luaV_equalobj (lua_State *L, const TValue *t1, const TValue *t2) {
     case LUA_TNUMFLT: return luai_numeq(fltvalue(t1), fltvalue(t2));
     case LUA_TBOOLEAN: return bvalue(t1) == bvalue(t2);  /* true must be 1 !! */
     case LUA_TLIGHTUSERDATA: return pvalue(t1) == pvalue(t2);
-    case LUA_TLCF: return fvalue(t1) == fvalue(t2);
+    case LUA_TLCF: case LUA_TLCFL: return fvalue(t1) == fvalue(t2);
     case LUA_TSHRSTR: return eqshrstr(tsvalue(t1), tsvalue(t2));
     case LUA_TLNGSTR: return luaS_eqlngstr(tsvalue(t1), tsvalue(t2));
     case LUA_TUSERDATA: {
@@ -494,6 +496,8 @@ void luaV_concat (lua_State *L, int total) {
           luaG_runerror(L, "string length overflow");
         tl += l;
       }
+      luai_vmstat(L, concat, 1);
+      luai_vmstat(L, concatbytes, tl);
       if (tl <= LUAI_MAXSHORTLEN) {  /* is result a short string? */
         char buff[LUAI_MAXSHORTLEN];
         copy2buff(top, n, buff);  /* copy strings to buffer */
@@ -664,7 +668,8 @@ void luaV_finishOp (lua_State *L) {
     case OP_BAND: case OP_BOR: case OP_BXOR: case OP_SHL: case OP_SHR:
     case OP_MOD: case OP_POW:
     case OP_UNM: case OP_BNOT: case OP_LEN:
-    case OP_GETTABUP: case OP_GETTABLE: case OP_SELF: {
+    case OP_GETTABUP: case OP_GETTABLE: case OP_SELF:
+    case OP_GETTABUP2: case OP_GETTABLE2: {  /* first lookup only */
       setobjs2s(L, base + GETARG_A(inst), --L->top);
       break;
     }
@@ -753,9 +758,17 @@ void luaV_finishOp (lua_State *L) {
            luai_threadyield(L); }
 
 
+/*
+** line and count hooks must see the fused GETTABLE, so it is only
+** skipped when they are off
+*/
+#define fusehooked(L)	((L)->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT))
+
+
 /* fetch an instruction and prepare its execution */
 #define vmfetch()	{ \
   i = *(ci->u.l.savedpc++); \
+  luai_vmstat(L, op[GET_OPCODE(i)], 1); \
   if (L->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT)) \
     Protect(luaG_traceexec(L)); \
   ra = RA(i); /* WARNING: any stack reallocation invalidates 'ra' */ \
@@ -845,6 +858,40 @@ void luaV_execute (lua_State *L) {
         gettableProtected(L, rb, rc, ra);
         vmbreak;
       }
+      vmcase(OP_GETTABUP2) {
+        TValue *upval = cl->upvals[GETARG_B(i)]->v;
+        TValue *rc = RKC(i);
+        const TValue *slot;
+        if (luaV_fastget(L, upval, rc, slot, luaH_get)) {
+          const TValue *slot2;
+          TValue *rc2 = k + INDEXK(GETARG_C(*ci->u.l.savedpc));
+          if (!fusehooked(L) && luaV_fastget(L, slot, rc2, slot2, luaH_get)) {
+            setobj2s(L, ra, slot2);
+            ci->u.l.savedpc++;  /* skip fused GETTABLE */
+            vmbreak;
+          }
+          setobj2s(L, ra, slot);  /* fused GETTABLE does the rest */
+        }
+        else Protect(luaV_finishget(L, upval, rc, ra, slot));
+        vmbreak;
+      }
+      vmcase(OP_GETTABLE2) {
+        StkId rb = RB(i);
+        TValue *rc = RKC(i);
+        const TValue *slot;
+        if (luaV_fastget(L, rb, rc, slot, luaH_get)) {
+          const TValue *slot2;
+          TValue *rc2 = k + INDEXK(GETARG_C(*ci->u.l.savedpc));
+          if (!fusehooked(L) && luaV_fastget(L, slot, rc2, slot2, luaH_get)) {
+            setobj2s(L, ra, slot2);
+            ci->u.l.savedpc++;  /* skip fused GETTABLE */
+            vmbreak;
+          }
+          setobj2s(L, ra, slot);  /* fused GETTABLE does the rest */
+        }
+        else Protect(luaV_finishget(L, rb, rc, ra, slot));
+        vmbreak;
+      }
       vmcase(OP_SETTABUP) {
         TValue *upval = cl->upvals[GETARG_A(i)]->v;
         TValue *rb = RKB(i);
@@ -1131,7 +1178,12 @@ void luaV_execute (lua_State *L) {
         int b = GETARG_B(i);
         int nresults = GETARG_C(i) - 1;
         if (b != 0) L->top = ra+b;  /* else previous instruction set top */
-        if (luaD_precall(L, ra, nresults)) {  /* C function? */
+        if (ttisleaf(ra)) {  /* leaf C function? */
+          Protect(luaD_callleaf(L, ra, nresults));
+          if (nresults >= 0)
+            L->top = ci->top;  /* adjust results */
+        }
+        else if (luaD_precall(L, ra, nresults)) {  /* C function? */
           if (nresults >= 0)
             L->top = ci->top;  /* adjust results */
           Protect((void)0);  /* update 'base' */
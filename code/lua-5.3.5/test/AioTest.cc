@@ -0,0 +1,68 @@
+#include "UnitTest++/src/UnitTest++.h"
+#include <string.h>
+
+extern "C" {
+    #include "lua.h"
+    #include "lauxlib.h"
+    #include "lualib.h"
+}
+
+// writes, reads back and stats 'n' temporary files from 'n' coroutines,
+// all in flight at once, with a minimal scheduler over 'aio.wait'
+static const char *source =
+    "local n = ...\n"
+    "local names, done = {}, 0\n"
+    "for i = 1, n do\n"
+    "  names[i] = os.tmpname()\n"
+    "  coroutine.wrap(function ()\n"
+    "    local data = string.rep(string.char(64 + i), 4096 * i)\n"
+    "    local f = assert(aio.open(names[i], 'w+'))\n"
+    "    assert(f:write(data, 0) == #data)\n"
+    "    assert(f:read(#data, 0) == data)\n"
+    "    assert(f:read(1, #data) == nil)\n"
+    "    assert(f:close())\n"
+    "    assert(aio.stat(names[i]).size == #data)\n"
+    "    done = done + 1\n"
+    "  end)()\n"
+    "end\n"
+    "local inflight = aio.pending()\n"
+    "while aio.pending() > 0 do aio.wait() end\n"
+    "for i = 1, n do os.remove(names[i]) end\n"
+    "return done, inflight\n";
+
+TEST(AioTest) {
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    CHECK_EQUAL(luaL_loadstring(L, source), LUA_OK);
+    lua_pushinteger(L, 16);
+    CHECK_EQUAL(lua_pcall(L, 1, 2, 0), LUA_OK);
+    CHECK_EQUAL(lua_tointeger(L, 1), 16);  // all coroutines finished
+    CHECK_EQUAL(lua_tointeger(L, 2), 16);  // all of them waited at once
+    lua_close(L);
+}
+
+// a file cannot be closed under a pending write, and a coroutine resumed
+// before its operation is done gets an error instead of the results
+static const char *misuse =
+    "local name = os.tmpname()\n"
+    "local f = assert(aio.open(name, 'w'))\n"
+    "local co = coroutine.create(function ()\n"
+    "  return f:write(string.rep('x', 1 << 20), 0)\n"
+    "end)\n"
+    "assert(coroutine.resume(co))\n"
+    "local closed = pcall(f.close, f)\n"
+    "local ok, msg = coroutine.resume(co)\n"
+    "while aio.pending() > 0 do aio.wait() end\n"
+    "assert(f:close())\n"
+    "os.remove(name)\n"
+    "return closed, ok, msg\n";
+
+TEST(AioMisuseTest) {
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    CHECK_EQUAL(luaL_dostring(L, misuse), LUA_OK);
+    CHECK(!lua_toboolean(L, 1));
+    CHECK(!lua_toboolean(L, 2));
+    CHECK(strstr(lua_tostring(L, 3), "before it was done") != NULL);
+    lua_close(L);
+}
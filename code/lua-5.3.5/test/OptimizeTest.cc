@@ -0,0 +1,42 @@
+#include "UnitTest++/src/UnitTest++.h"
+#include <string.h>
+
+extern "C" {
+    #include "lua.h"
+    #include "lauxlib.h"
+    #include "lualib.h"
+}
+
+static const char *source =
+    "local acc = 0\n"
+    "for i = 1, 10 do\n"
+    "  if 1 > 2 then acc = -100 end\n"
+    "  if i % 2 == 0 then acc = acc + i else acc = acc - 1 end\n"
+    "  while false do acc = 0 end\n"
+    "end\n"
+    "do return acc end\n"
+    "acc = 0\n";
+
+// runs 'source' loaded with 'mode'; returns its result and the size of its dump
+static lua_Integer run(const char *mode, size_t *dumpsize) {
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    luaL_loadbufferx(L, source, strlen(source), "=opt", mode);
+    lua_getglobal(L, "string");
+    lua_getfield(L, -1, "dump");
+    lua_pushvalue(L, -3);
+    lua_call(L, 1, 1);
+    *dumpsize = lua_rawlen(L, -1);
+    lua_pop(L, 2);
+    lua_call(L, 0, 1);
+    lua_Integer r = lua_tointeger(L, -1);
+    lua_close(L);
+    return r;
+}
+
+TEST(OptimizeTest) {
+    size_t plain, optimized;
+    CHECK_EQUAL(run("t", &plain), 25);
+    CHECK_EQUAL(run("to", &optimized), 25);
+    CHECK(optimized < plain);
+}
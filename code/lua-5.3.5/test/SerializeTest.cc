@@ -0,0 +1,44 @@
+#include "UnitTest++/src/UnitTest++.h"
+
+extern "C" {
+    #include "lua.h"
+    #include "lauxlib.h"
+    #include "lualib.h"
+}
+
+// hand-made payloads: a string whose only table entry is overwritten by
+// a repeated key must still be there for a later reference, while
+// allocations (and collections) go on; then some malformed data
+static const char *source =
+    "collectgarbage('setpause', 10)\n"
+    "local function varint (x)\n"
+    "  local s = ''\n"
+    "  while x >= 0x80 do s = s .. string.char(x % 0x80 + 0x80); x = x // 0x80 end\n"
+    "  return s .. string.char(x)\n"
+    "end\n"
+    "local function str (s) return string.char(0x40 + #s) .. s end\n"
+    "local TRUE, STRREF, TABLE = '\\2', '\\6', '\\7'\n"
+    "local n = 3000\n"
+    "local p = {TABLE, varint(0), varint(n + 3)}\n"
+    "p[#p + 1] = str('kk') .. str(string.rep('v', 30))\n"  // strings 1 and 2
+    "p[#p + 1] = STRREF .. varint(1) .. TRUE\n"  // kk = true
+    "for i = 1, n do p[#p + 1] = str('p' .. i) .. TRUE end\n"
+    "p[#p + 1] = str('zz') .. STRREF .. varint(2)\n"
+    "local t = serialize.decode(table.concat(p))\n"
+    "assert(t.kk == true and t.p1 and t['p' .. n])\n"
+    "assert(t.zz == string.rep('v', 30))\n"
+    "local bad = 0\n"
+    "for _, s in ipairs{'', TABLE, STRREF .. varint(1), TABLE .. '\\0\\1' .. TRUE,\n"
+    "                   TABLE .. '\\0\\1' .. '\\0' .. TRUE, '\\66a', '\\99'} do\n"
+    "  local ok, msg = pcall(serialize.decode, s)\n"
+    "  if not ok and msg:find('malformed') then bad = bad + 1 end\n"
+    "end\n"
+    "return bad\n";
+
+TEST(SerializeTest) {
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    CHECK_EQUAL(luaL_dostring(L, source), LUA_OK);
+    CHECK_EQUAL(lua_tointeger(L, -1), 7);  // all rejected
+    lua_close(L);
+}
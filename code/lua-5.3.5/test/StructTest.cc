@@ -0,0 +1,105 @@
+#include "UnitTest++/src/UnitTest++.h"
+#include <stddef.h>
+#include <string.h>
+
+extern "C" {
+    #include "lua.h"
+    #include "lauxlib.h"
+    #include "lualib.h"
+}
+
+struct Entity {
+    lua_Integer id;
+    lua_Number speed;
+    float x, y;
+    int hp;
+    int visible;
+    const char *name;
+};
+
+static const lua_Field fields[] = {
+    {"id", LUA_FINTEGER, offsetof(Entity, id)},
+    {"speed", LUA_FNUMBER, offsetof(Entity, speed)},
+    {"x", LUA_FFLOAT, offsetof(Entity, x)},
+    {"y", LUA_FFLOAT, offsetof(Entity, y)},
+    {"hp", LUA_FINT, offsetof(Entity, hp)},
+    {"visible", LUA_FBOOLEAN, offsetof(Entity, visible)},
+    {"name", LUA_FSTRING, offsetof(Entity, name)},
+};
+
+static const int nfields = sizeof(fields) / sizeof(fields[0]);
+
+// struct -> table -> struct, plus a field with a wrong value
+TEST(StructTest) {
+    lua_State *L = luaL_newstate();
+    Entity a = {7, 1.5, 0.25f, -2.0f, 100, 1, "orc"};
+    Entity b;
+    memset(&b, 0, sizeof(b));
+    lua_newtable(L);
+    lua_setstruct(L, 1, &a, fields, nfields);
+    CHECK_EQUAL(lua_getstruct(L, 1, &b, fields, nfields), 0);
+    CHECK_EQUAL(b.id, 7);
+    CHECK_EQUAL(b.speed, 1.5);
+    CHECK_EQUAL(b.x, 0.25f);
+    CHECK_EQUAL(b.y, -2.0f);
+    CHECK_EQUAL(b.hp, 100);
+    CHECK_EQUAL(b.visible, 1);
+    CHECK_EQUAL(strcmp(b.name, "orc"), 0);
+    lua_pushliteral(L, "fast");
+    lua_setfield(L, 1, "speed");
+    CHECK_EQUAL(lua_getstruct(L, 1, &b, fields, nfields), 2);
+    lua_close(L);
+}
+
+// reading several fields at once, through '__index' too
+TEST(GetFieldsTest) {
+    static const char *const keys[] = {"x", "y", "z", "w"};
+    lua_State *L = luaL_newstate();
+    lua_Number v[4];
+    luaL_openlibs(L);
+    CHECK_EQUAL(luaL_dostring(L, "return setmetatable({x = 1, y = '2'},"
+                                 " {__index = {z = 3.5}})"), LUA_OK);
+    CHECK_EQUAL(lua_getfields(L, -1, keys, 4), 3);
+    CHECK_EQUAL(lua_gettop(L), 5);
+    CHECK_EQUAL(lua_tonumbers(L, 2, 4, v), 3);  // stops at nil 'w'
+    CHECK_EQUAL(v[0], 1.0);
+    CHECK_EQUAL(v[1], 2.0);
+    CHECK_EQUAL(v[2], 3.5);
+    lua_close(L);
+}
+
+// interned keys survive collections, whether they were new or not
+TEST(InternKeyTest) {
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    lua_Key fresh = lua_internkey(L, "position");
+    lua_Key old = lua_internkey(L, "print");  // already a global's name
+    lua_Key reserved = lua_internkey(L, "end");
+    lua_pushstring(L, "velocity");  // last object allocated, but not new
+    lua_Key last = lua_internkey(L, "velocity");
+    lua_pop(L, 1);
+    lua_gc(L, LUA_GCCOLLECT, 0);
+    lua_gc(L, LUA_GCCOLLECT, 0);
+    lua_newtable(L);
+    lua_pushinteger(L, 42);
+    lua_setfieldk(L, 1, fresh);
+    lua_pushinteger(L, 43);
+    lua_setfieldk(L, 1, reserved);
+    CHECK_EQUAL(lua_getfield(L, 1, "position"), LUA_TNUMBER);
+    CHECK_EQUAL(lua_tointeger(L, -1), 42);
+    CHECK_EQUAL(lua_getfieldk(L, 1, reserved), LUA_TNUMBER);
+    CHECK_EQUAL(lua_tointeger(L, -1), 43);
+    lua_pushinteger(L, 45);
+    lua_setfieldk(L, 1, last);
+    CHECK_EQUAL(lua_getfield(L, 1, "velocity"), LUA_TNUMBER);
+    CHECK_EQUAL(lua_tointeger(L, -1), 45);
+    lua_pushglobaltable(L);
+    lua_pushnil(L);
+    lua_setfield(L, -2, "print");  // 'print' is now only in the handle
+    lua_gc(L, LUA_GCCOLLECT, 0);
+    lua_pushinteger(L, 44);
+    lua_setfieldk(L, -2, old);
+    CHECK_EQUAL(luaL_dostring(L, "return print"), LUA_OK);
+    CHECK_EQUAL(lua_tointeger(L, -1), 44);
+    lua_close(L);
+}
@@ -0,0 +1,37 @@
+#include "UnitTest++/src/UnitTest++.h"
+#include <string.h>
+
+extern "C" {
+    #include "lua.h"
+    #include "lauxlib.h"
+    #include "lualib.h"
+}
+
+// maps a job over an array of numbers and tables on a pool of 'n'
+// workers, checks the results come back in order, and that the error
+// of a failing job reaches the caller
+static const char *source =
+    "local n = ...\n"
+    "local pool = threads.pool(n)\n"
+    "local t = {}\n"
+    "for i = 1, 10000 do t[i] = {i, name = 'x' .. i} end\n"
+    "local r = pool:map('return function (v) return #v.name + v[1] end', t)\n"
+    "for i = 1, #t do assert(r[i] == #t[i].name + i) end\n"
+    "local ok, err = pcall(pool.map, pool,\n"
+    "  'return function (v) assert(v[1] ~= 77, \"bad\") end', t)\n"
+    "assert(not ok and err:find('bad'))\n"
+    "pool:run('return function (a, b) return a .. b, {b} end', 'a', 'b')\n"
+    "local id, ok, s, tb = pool:wait()\n"
+    "assert(ok and s == 'ab' and tb[1] == 'b')\n"
+    "pool:close()\n"
+    "return #r\n";
+
+TEST(ThreadsTest) {
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    CHECK_EQUAL(luaL_loadstring(L, source), LUA_OK);
+    lua_pushinteger(L, 4);
+    CHECK_EQUAL(lua_pcall(L, 1, 1, 0), LUA_OK);
+    CHECK_EQUAL(lua_tointeger(L, -1), 10000);
+    lua_close(L);
+}
@@ -0,0 +1,57 @@
+-- allocation profiler: overhead on an allocation-heavy workload, and
+-- the live bytes it finds for a table that is kept by mistake
+-- usage: lua alloc.lua [interval] [rounds]
+
+local interval = tonumber(arg and arg[1]) or 64 * 1024
+local rounds = tonumber(arg and arg[2]) or 5
+
+local cache = {}  -- the "leak": every record stays reachable from here
+
+local function record (i)
+  local r = {id = i, name = "item" .. i, tags = {i % 3, i % 5}}
+  cache[#cache + 1] = r
+  return r
+end
+
+local function churn (n)
+  local s = 0
+  for i = 1, n do
+    local t = {i, i + 1, tostring(i)}
+    s = s + #t
+  end
+  return s
+end
+
+local function work ()
+  for i = 1, rounds do
+    for j = 1, 20000 do record(j) end
+    churn(200000)
+  end
+end
+
+local function run (name)
+  cache = {}
+  collectgarbage()
+  local t0 = os.clock()
+  work()
+  local t = os.clock() - t0
+  print(string.format("%-10s %8.3f s", name, t))
+  return t
+end
+
+work()  -- warm up
+local off = run("off")
+profile.allocstart(interval)
+local on = run("on")
+collectgarbage()
+local sites = profile.allocs()
+profile.allocstop()
+print(string.format("overhead   %7.2f %%  (one sample every %d bytes)",
+                    (on - off) / off * 100, interval))
+print(string.format("heap       %8.0f KB", collectgarbage("count")))
+print()
+print(string.format("%-28s %12s %12s %8s", "site", "live", "total", "samples"))
+for i = 1, math.min(#sites, 10) do
+  local s = sites[i]
+  print(string.format("%-28s %12d %12d %8d", s.site, s.live, s.total, s.samples))
+end
@@ -0,0 +1,47 @@
+-- call/return throughput: shallow calls and deep recursion
+-- usage: lua calls.lua [scale]
+-- for stacks that never move, compare with a build using
+--   make linux MYCFLAGS=-DLUAI_STACKRESERVE
+
+local scale = tonumber(arg and arg[1]) or 1
+
+local function fib (n)
+  if n < 2 then return n end
+  return fib(n - 1) + fib(n - 2)
+end
+
+local function depth (n)
+  if n == 0 then return 0 end
+  return 1 + depth(n - 1)
+end
+
+local function run (name, f)
+  collectgarbage()
+  local t0 = os.clock()
+  f()
+  print(string.format("%-12s %8.3f s", name, os.clock() - t0))
+end
+
+run("fib", function () fib(29 + scale) end)
+run("C functions", function ()  -- light C functions (not leaf ones)
+  local abs, floor, max = math.abs, math.floor, math.max
+  local acc = 0
+  for i = 1, 2000000 * scale do acc = acc + abs(-i) + floor(i / 3) + max(i, 7) end
+end)
+run("deep", function ()
+  for i = 1, 20 * scale do
+    depth(100000)
+    collectgarbage()  -- lets the collector shrink the CallInfo list
+  end
+end)
+run("coroutines", function ()
+  local cos = {}
+  for i = 1, 1000 * scale do  -- many live threads, each with a deep stack
+    cos[i] = coroutine.create(function (n)
+      local function d (k) if k == 0 then coroutine.yield() return 0 end return 1 + d(k - 1) end
+      return d(n)
+    end)
+    coroutine.resume(cos[i], 5000)
+  end
+  for i = 1, #cos do coroutine.resume(cos[i]) end
+end)
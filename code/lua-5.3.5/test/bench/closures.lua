@@ -0,0 +1,24 @@
+-- closure creation under many open upvalues
+-- usage: lua closures.lua [closures]
+
+local n = tonumber(arg and arg[1]) or 1000000
+
+-- a frame with many captured locals, then many closures capturing the
+-- lowest one (an event-handler factory)
+local src = { "local n = ...\nlocal state = 0\nlocal keep = {}\n" }
+for i = 1, 150 do
+  src[#src + 1] = string.format(
+    "local v%d = %d; keep[%d] = function () return v%d end\n", i, i, i, i)
+end
+src[#src + 1] = [[
+local handlers = {}
+for j = 1, n do
+  handlers[j] = function () state = state + j end
+end
+return handlers
+]]
+local factory = assert(load(table.concat(src)))
+
+local t0 = os.clock()
+factory(n)
+print(string.format("%d closures  %.3f s", n, os.clock() - t0))
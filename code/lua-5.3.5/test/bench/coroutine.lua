@@ -0,0 +1,23 @@
+-- coroutine churn: one short-lived coroutine per "request"
+-- usage: lua coroutine.lua [requests]
+-- compare against a build without thread reuse:
+--   make linux MYCFLAGS=-DLUAI_MAXPOOLTHREADS=0
+
+local n = tonumber(arg and arg[1]) or 1000000
+
+local function handler (req)
+  local reply = coroutine.yield(req + 1)
+  return reply * 2
+end
+
+local t0 = os.clock()
+local acc = 0
+for i = 1, n do
+  local co = coroutine.create(handler)
+  local _, a = coroutine.resume(co, i)
+  local _, b = coroutine.resume(co, a)
+  acc = acc + b
+end
+local t = os.clock() - t0
+print(string.format("%d requests  %.3f s  %.0f req/s  (checksum %d)",
+                    n, t, n / t, acc))
@@ -0,0 +1,44 @@
+-- dispatch count and run time of chained field accesses
+-- usage: lua dispatch.lua [iterations]
+-- compare against a build without superinstructions:
+--   make linux MYCFLAGS=-DLUAI_NOFUSE
+
+local n = tonumber(arg and arg[1]) or 2000000
+
+local cfg = { window = { size = { w = 640, h = 480 } } }
+
+local workloads = {
+  { "library calls", function (n)
+      local acc = 0
+      for i = 1, n do acc = acc + math.floor(i / 3) + math.abs(-i) end
+      return acc
+    end },
+  { "nested fields", function (n)
+      local acc = 0
+      for i = 1, n do acc = acc + cfg.window.size.w + cfg.window.size.h end
+      return acc
+    end },
+  { "local fields", function (n)
+      local obj = { pos = { x = 1, y = 2 } }
+      local acc = 0
+      for i = 1, n do acc = acc + obj.pos.x * obj.pos.y end
+      return acc
+    end },
+}
+
+local function dispatches (f, n)
+  local count = 0
+  debug.sethook(function () count = count + 1 end, "", 1)
+  f(n)
+  debug.sethook()
+  return count
+end
+
+print(string.format("%-16s %12s %10s", "workload", "instr/iter", "seconds"))
+for _, w in ipairs(workloads) do
+  local name, f = w[1], w[2]
+  local d = dispatches(f, 1000) / 1000
+  local t0 = os.clock()
+  f(n)
+  print(string.format("%-16s %12.2f %10.3f", name, d, os.clock() - t0))
+end
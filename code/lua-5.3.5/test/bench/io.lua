@@ -0,0 +1,87 @@
+-- buffered I/O: numbers with f:read("n"), lines with f:lines(), and
+-- report-like output with many small fields per f:write
+-- usage: lua io.lua [numbers] [rounds]
+
+local count = tonumber(arg and arg[1]) or 1000000
+local rounds = tonumber(arg and arg[2]) or 3
+local fname = os.tmpname()
+
+local f = assert(io.open(fname, "w"))
+for i = 1, count do
+  local x = (i * 7919) % 1000003
+  if i % 3 == 0 then x = x / 64 end
+  f:write(x, (i % 10 == 0) and "\n" or " ")
+end
+f:close()
+print(string.format("file       %8.1f MB", #assert(io.open(fname)):read("a") / 1e6))
+
+local function run (name, read)
+  collectgarbage()
+  local t0 = os.clock()
+  for i = 1, rounds do
+    local f = assert(io.open(fname))
+    read(f)
+    f:close()
+  end
+  print(string.format("%-10s %8.3f s", name, os.clock() - t0))
+end
+
+run("numbers", function (f)
+  local n, s = 0, 0
+  while true do
+    local x = f:read("n")
+    if not x then break end
+    n, s = n + 1, s + x
+  end
+  assert(n == count)
+end)
+
+run("4 numbers", function (f)
+  local n = 0
+  while true do
+    local a, b, c, d = f:read("n", "n", "n", "n")
+    if not a then break end
+    n = n + 1
+  end
+end)
+
+run("lines", function (f)
+  local n = 0
+  for l in f:lines() do n = n + 1 end
+  assert(n == count // 10)
+end)
+
+run("lines L", function (f)
+  local n = 0
+  for l in f:lines("L") do n = n + #l end
+end)
+
+local function runwrite (name, mode, write)
+  collectgarbage()
+  local t0 = os.clock()
+  for i = 1, rounds do
+    local f = assert(io.open(fname, mode))
+    write(f)
+    f:close()
+  end
+  print(string.format("%-10s %8.3f s", name, os.clock() - t0))
+end
+
+runwrite("fields", "w", function (f)
+  for i = 1, count // 4 do
+    f:write(i, ",", i * 0.5, ",", "name", ",", -i, "\n")
+  end
+end)
+
+runwrite("fields d", "wd", function (f)
+  for i = 1, count // 4 do
+    f:write(i, ",", i * 0.5, ",", "name", ",", -i, "\n")
+  end
+end)
+
+local block = string.rep("x", 100000)
+runwrite("blocks", "w", function (f)
+  for i = 1, 100 do f:write(block, "\n", block, "\n") end
+end)
+
+os.remove(fname)
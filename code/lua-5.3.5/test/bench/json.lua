@@ -0,0 +1,163 @@
+-- json.decode/json.encode against a plain Lua JSON implementation
+-- (the usual string.find/string.sub scanner and table.concat writer)
+-- on a generated corpus of records
+-- usage: lua json.lua [megabytes]
+
+local mb = tonumber(arg and arg[1]) or 100
+
+
+-- {==================================================================
+-- Lua implementation
+-- ===================================================================
+
+local escapes = {['"'] = '\\"', ['\\'] = '\\\\', ['\b'] = '\\b',
+                 ['\f'] = '\\f', ['\n'] = '\\n', ['\r'] = '\\r',
+                 ['\t'] = '\\t'}
+
+local function escape (c)
+  return escapes[c] or string.format("\\u%04x", c:byte())
+end
+
+local function write (v, out)
+  local t = type(v)
+  if t == "table" then
+    if #v > 0 or next(v) == nil then
+      out[#out + 1] = "["
+      for i = 1, #v do
+        if i > 1 then out[#out + 1] = "," end
+        write(v[i], out)
+      end
+      out[#out + 1] = "]"
+    else
+      local first = true
+      out[#out + 1] = "{"
+      for k, x in pairs(v) do
+        out[#out + 1] = first and '"' or ',"'
+        out[#out + 1] = tostring(k):gsub('[%c"\\]', escape)
+        out[#out + 1] = '":'
+        write(x, out)
+        first = false
+      end
+      out[#out + 1] = "}"
+    end
+  elseif t == "string" then
+    out[#out + 1] = '"' .. v:gsub('[%c"\\]', escape) .. '"'
+  elseif math.type(v) == "float" then
+    out[#out + 1] = string.format("%.17g", v)
+  else
+    out[#out + 1] = tostring(v)
+  end
+end
+
+local function luaencode (v)
+  local out = {}
+  write(v, out)
+  return table.concat(out)
+end
+
+
+local read
+
+local function readstring (s, i)
+  local buff, j = {}, i + 1
+  while true do
+    local k = s:find('["\\]', j)
+    if not k then error("unfinished string") end
+    buff[#buff + 1] = s:sub(j, k - 1)
+    if s:byte(k) == 34 then return table.concat(buff), k + 1 end
+    local c = s:sub(k + 1, k + 1)
+    if c == "u" then
+      buff[#buff + 1] = utf8.char(tonumber(s:sub(k + 2, k + 5), 16))
+      j = k + 6
+    else
+      buff[#buff + 1] = ({b = "\b", f = "\f", n = "\n", r = "\r",
+                          t = "\t"})[c] or c
+      j = k + 2
+    end
+  end
+end
+
+function read (s, i)
+  i = s:find("%S", i)
+  local c = s:byte(i)
+  if c == 123 then  -- '{'
+    local t = {}
+    i = s:find("%S", i + 1)
+    if s:byte(i) == 125 then return t, i + 1 end
+    while true do
+      local k
+      k, i = readstring(s, s:find("%S", i))
+      i = s:find(":", i, true)
+      t[k], i = read(s, i + 1)
+      i = s:find("%S", i)
+      c = s:byte(i)
+      if c == 125 then return t, i + 1 end
+      i = i + 1
+    end
+  elseif c == 91 then  -- '['
+    local t, n = {}, 0
+    i = s:find("%S", i + 1)
+    if s:byte(i) == 93 then return t, i + 1 end
+    while true do
+      n = n + 1
+      t[n], i = read(s, i)
+      i = s:find("%S", i)
+      c = s:byte(i)
+      if c == 93 then return t, i + 1 end
+      i = i + 1
+    end
+  elseif c == 34 then
+    return readstring(s, i)
+  elseif s:find("^true", i) then return true, i + 4
+  elseif s:find("^false", i) then return false, i + 5
+  elseif s:find("^null", i) then return nil, i + 4
+  else
+    local num = s:match("^-?%d+%.?%d*[eE]?[-+]?%d*", i)
+    return math.tointeger(num) or tonumber(num), i + #num
+  end
+end
+
+local function luadecode (s)
+  return (read(s, 1))
+end
+
+-- }==================================================================
+
+
+local corpus = {}
+do
+  local size, i = 0, 0
+  while size < mb * 2^20 do
+    i = i + 1
+    local r = {
+      id = i, name = "user_" .. i, email = "user" .. i .. "@example.com",
+      active = i % 3 ~= 0, score = i * 1.25, balance = -i / 7,
+      bio = "line one\nline \"two\"\twith a\\backslash " .. i,
+      tags = {"alpha", "beta", "gamma" .. i % 10},
+      position = {lat = 40 + i % 90 / 3, lon = -70 - i % 180 / 7},
+      history = {i, i * 2, i * 3, i * 4, i * 5},
+    }
+    corpus[i] = r
+    size = size + #json.encode(r) + 1
+  end
+end
+
+
+local function bench (name, encode, decode)
+  collectgarbage()
+  local t0 = os.clock()
+  local s = encode(corpus)
+  local t1 = os.clock()
+  local r = decode(s)
+  local t2 = os.clock()
+  print(string.format("%-5s encode %8.3f s  decode %8.3f s  %6.1f MB/s",
+                      name, t1 - t0, t2 - t1, #s / 2^20 / (t2 - t1)))
+  assert(#r == #corpus and r[#r].bio == corpus[#corpus].bio)
+  return t1 - t0, t2 - t1
+end
+
+print(string.format("corpus: %d records, %.1f MB",
+                    #corpus, #json.encode(corpus) / 2^20))
+local le, ld = bench("Lua", luaencode, luadecode)
+local ce, cd = bench("json", json.encode, json.decode)
+print(string.format("speedup: encode %.1fx  decode %.1fx", le / ce, ld / cd))
@@ -0,0 +1,61 @@
+-- line iteration over a file: io.lines against a mapped file, both
+-- creating line strings and taking only their positions
+-- usage: lua mmap.lua [lines] [rounds]
+
+local nlines = tonumber(arg and arg[1]) or 500000
+local rounds = tonumber(arg and arg[2]) or 5
+local fname = os.tmpname()
+
+local f = assert(io.open(fname, "w"))
+for i = 1, nlines do
+  f:write("line ", i, " of the benchmark file, ", i * 7 % 1000, "\n")
+end
+f:close()
+
+local function run (name, count)
+  collectgarbage()
+  local t0 = os.clock()
+  local n
+  for i = 1, rounds do n = count() end
+  local t = os.clock() - t0
+  assert(n == nlines)
+  print(string.format("%-14s %8.3f s", name, t))
+end
+
+run("io.lines", function ()
+  local n = 0
+  for l in io.lines(fname) do n = n + 1 end
+  return n
+end)
+
+run("mmap lines", function ()
+  local n = 0
+  local m = assert(io.mmap(fname))
+  for l in m:lines() do n = n + 1 end
+  m:close()
+  return n
+end)
+
+run("mmap lines p", function ()
+  local n = 0
+  local m = assert(io.mmap(fname))
+  for i, j in m:lines("p") do n = n + 1 end
+  m:close()
+  return n
+end)
+
+run("mmap find", function ()
+  local n = 0
+  local m = assert(io.mmap(fname))
+  local i = 1
+  while true do
+    local _, e = m:find("\n", i, true)
+    if not e then break end
+    n = n + 1
+    i = e + 1
+  end
+  m:close()
+  return n
+end)
+
+os.remove(fname)
@@ -0,0 +1,40 @@
+-- parse throughput: compiles a generated data-definition chunk
+-- usage: lua parse.lua [megabytes] [rounds]
+
+local mb = tonumber(arg and arg[1]) or 8
+local rounds = tonumber(arg and arg[2]) or 5
+
+local function corpus (size)
+  local parts, n, len = {}, 0, 0
+  local i = 0
+  while len < size do
+    i = i + 1
+    local s = string.format([=[
+-- item definition %d: generated, do not edit
+--[==[ notes for item %d, spanning
+    a couple of lines with ]] inside ]==]
+items[%d] = {
+  identifier_name = "item_%d_name", category = "weapon",
+  description = [==[%d: short text]==],
+  weight = %d.%d, price = 0x%X, tags = { "alpha", 'beta', "esc\t\"%d\"" },
+  flags = { is_enabled = true, is_hidden = false, level = %d },
+}
+]=], i, i, i, i, i, i % 97, i % 10, i * 31, i, i % 60)
+    n = n + 1
+    parts[n] = s
+    len = len + #s
+  end
+  return "local items = {}\n" .. table.concat(parts) .. "return items\n"
+end
+
+local src = corpus(mb * 1024 * 1024)
+local best = math.huge
+for _ = 1, rounds do
+  local t0 = os.clock()
+  assert(load(src, "=corpus"))
+  local t = os.clock() - t0
+  if t < best then best = t end
+  collectgarbage()
+end
+print(string.format("parse: %.2f MB in %.3f s (best of %d) = %.1f MB/s",
+                    #src / 2^20, best, rounds, #src / 2^20 / best))
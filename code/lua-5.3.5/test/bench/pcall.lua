@@ -0,0 +1,27 @@
+-- protected-call overhead: an RPC layer wrapping every handler in pcall
+-- usage: lua pcall.lua [calls]
+-- compare the setjmp build with the C++ exception build:
+--   make linux                    (setjmp/longjmp)
+--   make linux CC=g++             (C++ exceptions; or LUA_USE_CXX_EXCEPTIONS
+--                                  in the fips/cmake build)
+
+local n = tonumber(arg and arg[1]) or 2000000
+
+local function handler (req) return req + 1 end
+local function failing (req) error(req) end
+local function nested (req) return select(2, pcall(handler, req)) end
+
+local function run (name, f, n)
+  local t0 = os.clock()
+  for i = 1, n do f(i) end
+  local t = os.clock() - t0
+  print(string.format("%-14s %8.3f s  %6.0f ns/call", name, t, t / n * 1e9))
+end
+
+run("direct", handler, n)
+run("pcall ok", function (i) return pcall(handler, i) end, n)
+run("pcall nested", function (i) return pcall(nested, i) end, n)
+run("pcall error", function (i) return pcall(failing, i) end, n // 10)
+run("coroutine", function (i)
+  return coroutine.resume(coroutine.create(handler), i)
+end, n // 10)
@@ -0,0 +1,44 @@
+-- sampling profiler overhead: the same workload with and without sampling
+-- usage: lua profile.lua [hz] [rounds]
+-- prints the stacks seen (collapsed format, for flame graph tools)
+
+local hz = tonumber(arg and arg[1]) or 1000
+local rounds = tonumber(arg and arg[2]) or 30
+
+local function leaf (n)
+  local s = 0
+  for i = 1, n do s = s + i % 7 end
+  return s
+end
+
+local function mid (n) return leaf(n) + leaf(n // 2) end
+
+local function strings (n)
+  local t = {}
+  for i = 1, n do t[#t + 1] = tostring(i) end
+  return #table.concat(t, ",")
+end
+
+local function work ()
+  local acc = 0
+  for i = 1, rounds do acc = acc + mid(200000) + strings(20000) end
+  return acc
+end
+
+local function run (name)
+  local t0 = os.clock()
+  work()
+  local t = os.clock() - t0
+  print(string.format("%-10s %8.3f s", name, t))
+  return t
+end
+
+work()  -- warm up
+local off = run("off")
+profile.start(hz)
+local on = run("on")
+profile.stop()
+local stacks, total = profile.dump()
+print(string.format("overhead   %7.2f %%  (%d samples at %d Hz)",
+                    (on - off) / off * 100, total, hz))
+io.write(stacks)
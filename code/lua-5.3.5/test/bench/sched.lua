@@ -0,0 +1,100 @@
+-- task switches: ping-pong over channels with the native scheduler and
+-- with a typical Lua scheduler (table queues and coroutine.resume), and
+-- the cost of many short-lived tasks alive at once
+-- usage: lua sched.lua [round trips] [tasks]
+
+local rounds = tonumber(arg and arg[1]) or 1000000
+local ntasks = tonumber(arg and arg[2]) or 100000
+
+local function report (name, t, switches)
+  print(string.format("%-16s %8.3f s %8.1f ns/switch", name, t,
+                      t / switches * 1e9))
+end
+
+
+-- native scheduler
+do
+  local ping, pong = sched.channel(), sched.channel()
+  sched.spawn(function ()
+    for i = 1, rounds do ping:send(i); pong:recv() end
+    ping:close()
+  end)
+  sched.spawn(function ()
+    for v in ping.recv, ping do pong:send(v) end
+  end)
+  local t0 = os.clock()
+  sched.run()
+  report("sched channels", os.clock() - t0, 2 * rounds)
+end
+
+do
+  local n = 0
+  for i = 1, 2 do
+    sched.spawn(function ()
+      for i = 1, rounds do n = n + 1; sched.yield() end
+    end)
+  end
+  local t0 = os.clock()
+  sched.run()
+  report("sched yield", os.clock() - t0, 2 * rounds)
+end
+
+
+-- a Lua scheduler, as projects usually write one
+do
+  local ready, first, last = {}, 1, 0
+  local waiting = {}  -- channel -> queue of coroutines
+  local function wake (co, ...)
+    last = last + 1; ready[last] = table.pack(co, ...)
+  end
+  local function newchannel () return {items = {}, waiters = {}} end
+  local function send (ch, v)
+    local w = table.remove(ch.waiters, 1)
+    if w then wake(w, v) else ch.items[#ch.items + 1] = v end
+  end
+  local function recv (ch)
+    if #ch.items > 0 then return table.remove(ch.items, 1) end
+    ch.waiters[#ch.waiters + 1] = coroutine.running()
+    return coroutine.yield()
+  end
+  local function spawn (f) wake(coroutine.create(f)) end
+  local function run ()
+    while first <= last do
+      local r = ready[first]; ready[first] = nil; first = first + 1
+      assert(coroutine.resume(r[1], table.unpack(r, 2, r.n)))
+    end
+  end
+  local ping, pong = newchannel(), newchannel()
+  spawn(function ()
+    for i = 1, rounds do send(ping, i); recv(pong) end
+    send(ping, false)
+  end)
+  spawn(function ()
+    while true do
+      local v = recv(ping)
+      if not v then break end
+      send(pong, v)
+    end
+  end)
+  local t0 = os.clock()
+  run()
+  report("lua scheduler", os.clock() - t0, 2 * rounds)
+end
+
+
+-- many tasks alive at once, each sleeping once
+do
+  collectgarbage()
+  local m0 = collectgarbage("count")
+  local done = 0
+  local t0 = os.clock()
+  for i = 1, ntasks do
+    sched.spawn(function () sched.sleep(0); sched.yield(); done = done + 1 end)
+  end
+  local mem = collectgarbage("count") - m0
+  sched.run()
+  local t = os.clock() - t0
+  assert(done == ntasks)
+  print(string.format("%d tasks       %8.3f s %8.0f bytes/task", ntasks, t,
+                      mem * 1024 / ntasks))
+end
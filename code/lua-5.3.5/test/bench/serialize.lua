@@ -0,0 +1,74 @@
+-- round trip of a game-state-like table: serialize.encode/decode
+-- against a typical Lua serializer (pieces joined by table.concat,
+-- read back with 'load')
+-- usage: lua serialize.lua [entities] [rounds]
+
+local nent = tonumber(arg and arg[1]) or 2000
+local rounds = tonumber(arg and arg[2]) or 20
+
+local function report (name, tenc, tdec, bytes)
+  print(string.format("%-10s encode %8.1f us  decode %8.1f us  %8d bytes",
+                      name, tenc / rounds * 1e6, tdec / rounds * 1e6, bytes))
+end
+
+
+local state = {tick = 12345, map = "dungeon_03", entities = {}}
+for i = 1, nent do
+  state.entities[i] = {
+    id = i, kind = (i % 3 == 0) and "monster" or "item",
+    name = "entity_" .. i, health = 100 - i % 100, speed = 1.5 + i / 7,
+    position = {x = i * 0.25, y = -i, z = 0},
+    flags = {visible = true, solid = i % 2 == 0},
+    inventory = {i, i + 1, i + 2},
+  }
+end
+
+
+local function dump (v, out)
+  local t = type(v)
+  if t == "table" then
+    out[#out + 1] = "{"
+    for k, x in pairs(v) do
+      out[#out + 1] = "["
+      dump(k, out)
+      out[#out + 1] = "]="
+      dump(x, out)
+      out[#out + 1] = ","
+    end
+    out[#out + 1] = "}"
+  elseif t == "string" then
+    out[#out + 1] = string.format("%q", v)
+  elseif math.type(v) == "float" then
+    out[#out + 1] = string.format("%.17g", v)
+  else
+    out[#out + 1] = tostring(v)
+  end
+end
+
+local function luaencode (v)
+  local out = {"return "}
+  dump(v, out)
+  return table.concat(out)
+end
+
+local function luadecode (s)
+  return assert(load(s, "=data", "t", {}))()
+end
+
+
+local function bench (name, encode, decode)
+  local s, r
+  collectgarbage()
+  local t0 = os.clock()
+  for i = 1, rounds do s = encode(state) end
+  local t1 = os.clock()
+  for i = 1, rounds do r = decode(s) end
+  local t2 = os.clock()
+  report(name, t1 - t0, t2 - t1, #s)
+  assert(r.entities[nent].name == state.entities[nent].name)
+  return t2 - t0
+end
+
+local tl = bench("Lua", luaencode, luadecode)
+local tc = bench("serialize", serialize.encode, serialize.decode)
+print(string.format("round trip speedup: %.1fx", tl / tc))
@@ -0,0 +1,48 @@
+-- data-parallel map over a worker pool against the same loop in the
+-- calling state, for a cheap and a costly job, and the round trip of
+-- a job with no work (wall time, from 'sched.now')
+-- usage: lua threads.lua [elements] [workers]
+
+local n = tonumber(arg and arg[1]) or 200000
+local nworkers = tonumber(arg and arg[2])
+
+local cheap = "return function (x) return x * 2 + 1 end"
+local costly = [[
+return function (x)
+  local s = 0
+  for i = 1, 200 do s = s + math.sin(x + i) end
+  return s
+end
+]]
+
+local function report (name, t, count, unit)
+  print(string.format("%-16s %8.3f s %8.1f ns/%s", name, t,
+                      t / count * 1e9, unit or "element"))
+end
+
+local data = {}
+for i = 1, n do data[i] = i end
+
+local pool = threads.pool(nworkers)
+print(string.format("%d workers, %d elements", #pool, n))
+
+for _, job in ipairs{{"cheap", cheap}, {"costly", costly}} do
+  local f = load(job[2])()
+  local t0 = sched.now()
+  local r1 = {}
+  for i = 1, n do r1[i] = f(data[i]) end
+  report(job[1] .. " serial", sched.now() - t0, n)
+  t0 = sched.now()
+  local r2 = pool:map(job[2], data)
+  report(job[1] .. " map", sched.now() - t0, n)
+  assert(#r2 == n and r2[n] == r1[n])
+end
+
+local rounds = n // 10
+local t0 = sched.now()
+for i = 1, rounds do
+  pool:run("return function (x) return x end", i)
+  pool:wait()
+end
+report("job round trip", sched.now() - t0, rounds, "job")
+pool:close()
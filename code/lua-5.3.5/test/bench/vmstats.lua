@@ -0,0 +1,31 @@
+-- VM counters of a script: instructions by opcode, metamethod fallbacks,
+-- calls by callee type and concatenation volume
+-- needs an interpreter built with LUAI_VMSTATS:
+--   make linux MYCFLAGS=-DLUAI_VMSTATS
+-- usage: lua vmstats.lua script.lua [args]
+
+local script = assert(arg and arg[1], "usage: lua vmstats.lua script.lua [args]")
+local chunk = assert(loadfile(script))
+assert(debug.vmstats(true), "interpreter built without LUAI_VMSTATS")
+
+chunk(table.unpack(arg, 2))
+local st = debug.vmstats()
+
+local ops, total = {}, 0
+for name, n in pairs(st.ops) do
+  ops[#ops + 1] = {name, n}
+  total = total + n
+end
+table.sort(ops, function (a, b) return a[2] > b[2] end)
+print(string.format("%-12s %14s %7s", "opcode", "count", "%"))
+for _, op in ipairs(ops) do
+  print(string.format("%-12s %14d %6.2f%%", op[1], op[2], op[2] / total * 100))
+end
+print(string.format("%-12s %14d", "total", total))
+print()
+for _, k in ipairs{"lua", "c", "light", "leaf"} do
+  print(string.format("calls %-6s %14d", k, st.calls[k]))
+end
+print(string.format("%-12s %14d", "finishget", st.finishget))
+print(string.format("%-12s %14d", "finishset", st.finishset))
+print(string.format("%-12s %14d  (%d bytes)", "concat", st.concat, st.concatbytes))